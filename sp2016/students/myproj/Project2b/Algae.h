@@ -8,7 +8,10 @@
 class Algae : public LifeForm {
   static void initialize(void);
   Event* photo_event;
-  void photosynthesize(void);
+  void photosynthesize(void);   // with LAZY_ENERGY, photosynthesis is a
+                                // stream in the LifeForm's EnergyAccount
+                                // (Algae_energy_gain every algae_photo_time)
+                                // and there are no photo events
 public:
   Algae(void);
   void draw(int,int) const;     // defines LifeForm::draw
@@ -16,6 +19,7 @@ public:
   std::string species_name(void) const;
   std::string player_name(void) const;
   virtual Action encounter(const ObjInfo&);
+  void forget_events(void) { photo_event = nullptr; }
   static SmartPointer<LifeForm> create(void);
   static void create_spontaneously(void);
   friend class Initializer<Algae>;
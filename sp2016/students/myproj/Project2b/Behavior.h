@@ -0,0 +1,200 @@
+#if !(_Behavior_h)
+#define _Behavior_h 1
+
+/*
+ * Coroutine-based species behaviours (requires C++20: -std=c++20).
+ *
+ * A species written with callbacks has to chain its steps through the
+ * event queue: hunt() schedules an Event whose handler calls hunt() again,
+ * allocating a new Event and a new std::function every time.  With a
+ * Behavior, the species writes its life as one loop:
+ *
+ *   Behavior Craig::live(void) {
+ *     Sim sim(*this);
+ *     for (;;) {
+ *       ObjList prey = co_await sim.perceive(20.0);
+ *       ...
+ *       co_await sim.sleep(5.0);
+ *     }
+ *   }
+ *
+ *   Craig::Craig(void) : behavior(live()) { behavior.start(); }
+ *
+ * The coroutine frame is allocated once, when the behaviour starts, from
+ * a pool of recycled frames (FramePool).  sleep() puts a resume action on
+ * the LifeForm's WakeTimer, so a step costs a local timer update instead
+ * of a new heap Event.  The coroutine is not resumed once the LifeForm is
+ * dead, and destroying the Behavior (with its LifeForm) destroys the
+ * frame.
+ *
+ * A step may kill its LifeForm (perceive charges perceive_cost), and the
+ * LifeForm owns the frame that is running.  So every resume holds a
+ * SmartPointer to the LifeForm until the coroutine suspends again: a
+ * LifeForm that dies in a step is destroyed only after the step.  (The
+ * first step, start() in the constructor, runs before anything holds the
+ * LifeForm, so it cannot be destroyed there either.)
+ *
+ * This header is empty when the compiler has no coroutine support, so the
+ * rest of the simulator still builds as C++14.
+ */
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <vector>
+
+#include "LifeForm.h"
+#include "ObjInfo.h"
+
+/*
+ * Class name: FramePool
+ * Description:
+ *  Per-thread free lists of coroutine frames, by size class (multiples of
+ *  64 bytes).  A dead LifeForm's frame is reused by the next behaviour
+ *  (of any species) with a frame of the same size class, so steady-state
+ *  behaviours do not call operator new.  Each list keeps at most
+ *  max_free frames; the rest are freed, so a population that shrinks
+ *  gives its memory back.  A frame released after the thread's lists are
+ *  destroyed (the default Habitat outlives the main thread's) is freed at
+ *  once.
+ */
+class FramePool {
+  static const size_t granule = 64;
+  static const size_t num_classes = 32;  // frames up to 2KB are pooled
+  static const size_t max_free = 1024;   // per size class (and thread)
+
+  struct Lists {
+    std::vector<void*> free[num_classes];
+    ~Lists(void) {
+      gone() = true;
+      for (auto& list : free)
+        for (void* p : list) ::operator delete(p);
+    }
+  };
+
+  static std::vector<void*>* free_lists(void) {
+    static thread_local Lists lists;
+    return lists.free;
+  }
+
+  /* true once this thread's Lists is destroyed */
+  static bool& gone(void) {
+    static thread_local bool g = false;
+    return g;
+  }
+
+public:
+  static void* allocate(size_t n) {
+    size_t k = (n + granule - 1) / granule;
+    if (k >= num_classes || gone()) return ::operator new(n);
+    std::vector<void*>& list = free_lists()[k];
+    if (list.empty()) return ::operator new(k * granule);
+    void* p = list.back();
+    list.pop_back();
+    return p;
+  }
+
+  static void release(void* p, size_t n) {
+    size_t k = (n + granule - 1) / granule;
+    if (k >= num_classes || gone() || free_lists()[k].size() >= max_free) {
+      ::operator delete(p);
+      return;
+    }
+    free_lists()[k].push_back(p);
+  }
+};
+
+class Behavior {
+public:
+  struct promise_type {
+    Behavior get_return_object(void) {
+      return Behavior(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend(void) noexcept { return {}; }
+    std::suspend_always final_suspend(void) noexcept { return {}; }
+    void return_void(void) {}
+    void unhandled_exception(void) { std::terminate(); }
+
+    static void* operator new(size_t n) { return FramePool::allocate(n); }
+    static void operator delete(void* p, size_t n) { FramePool::release(p, n); }
+  };
+
+  Behavior(void) {}
+  Behavior(Behavior&& b) : handle(b.handle) { b.handle = nullptr; }
+  Behavior& operator=(Behavior&& b) {
+    if (this != &b) {
+      destroy();
+      handle = b.handle;
+      b.handle = nullptr;
+    }
+    return *this;
+  }
+  ~Behavior(void) { destroy(); }
+
+  /* run the behaviour up to its first co_await */
+  void start(void) { if (handle && !handle.done()) handle.resume(); }
+  bool done(void) const { return !handle || handle.done(); }
+
+private:
+  std::coroutine_handle<promise_type> handle;
+
+  explicit Behavior(std::coroutine_handle<promise_type> h) : handle(h) {}
+  Behavior(const Behavior&) = delete;
+  Behavior& operator=(const Behavior&) = delete;
+
+  void destroy(void) {
+    if (handle) handle.destroy();
+    handle = nullptr;
+  }
+};
+
+/*
+ * Class name: Sim
+ * Description:
+ *  The awaitable operations a Behavior may use on behalf of its LifeForm.
+ */
+class Sim {
+  LifeForm& self;
+
+public:
+  explicit Sim(LifeForm& self) : self(self) {}
+
+  struct Sleep {
+    LifeForm& self;
+    SimTime delta;
+    EventTag tag;
+    bool await_ready(void) const { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+      LifeForm* lf = &self;
+      self.timers.schedule(delta, tag, [lf, h]() {
+        if (!lf->is_alive) return;
+        SmartPointer<LifeForm> hold(lf);   // (the step may kill it: see above)
+        h.resume();
+      });
+    }
+    void await_resume(void) const {}
+  };
+
+  struct Perceive {
+    LifeForm& self;
+    double radius;
+    bool await_ready(void) const { return true; }   // perceiving takes no time
+    void await_suspend(std::coroutine_handle<>) {}
+    ObjList await_resume(void) { return self.perceive(radius); }  // (may kill self)
+  };
+
+  /* resume the behaviour 'delta' time units from now */
+  Sleep sleep(SimTime delta, EventTag tag = EVENT_HUNT) { return Sleep{ self, delta, tag }; }
+
+  /* look around (charging perceive_cost, exactly like LifeForm::perceive) */
+  Perceive perceive(double radius) { return Perceive{ self, radius }; }
+
+  bool alive(void) const { return self.is_alive; }
+  SimTime now(void) const { return Event::now(); }
+};
+
+#endif /* __cpp_impl_coroutine */
+
+#endif /* !(_Behavior_h) */
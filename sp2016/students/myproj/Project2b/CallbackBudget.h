@@ -0,0 +1,189 @@
+#if !(_CallbackBudget_h)
+#define _CallbackBudget_h 1
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include "CycleClock.h"
+#include "EventProfile.h"
+#include "SimTime.h"
+#include "Species.h"
+
+/*
+ * Per-callback compute budget (CALLBACK_BUDGET).
+ *
+ * One species that loops on huge perceive() calls, or thinks for a long
+ * time in encounter(), can stall every other species.  With
+ * CALLBACK_BUDGET every call into species code (the same calls that
+ * SPECIES_PROFILING times) runs under a CallbackWatchdog::Scope.  The
+ * species has budget_us microseconds of CPU (measured with CycleClock) per
+ * call, or per object for a batch call.
+ *
+ * The budget is checked at the engine entry points a species calls
+ * (perceive, set_course, set_speed and reproduce call check() in
+ * LifeForm.cpp), and once more when the callback returns.  A callback that
+ * has overrun is handled by the policy:
+ *   BUDGET_THROTTLE  the rest of its engine calls are refused (check()
+ *                    returns true: perceive sees nothing, set_course and
+ *                    the others do nothing).  Its species is throttled for
+ *                    throttle_period: any event with a species tag
+ *                    (EventProfiler::is_species_tag) created while one of
+ *                    that species' callbacks runs is delayed by at least
+ *                    throttle_delay, so the species runs less often.  The
+ *                    engine's events (border crossings, aging, digestion,
+ *                    samplers) keep their times.
+ *   BUDGET_KILL      as above, and the object(s) the callback ran for die
+ *                    when it returns.  (Batched encounter calls run in
+ *                    parallel, where nothing may die, so they are only
+ *                    throttled.)
+ * A single callback cannot be interrupted, so a species that never calls
+ * the engine is only caught when it returns.  Either way its next call
+ * comes later (or never), so the wall time per simulated time unit stays
+ * bounded.
+ *
+ * The budget is measured in wall-clock time, so whether (and when) a
+ * callback overruns depends on the machine and its load.  A run with
+ * CALLBACK_BUDGET that throttles or kills is therefore not repeatable:
+ * the same seed can give a different run, and a REPLAY_LOG recording of
+ * it may diverge on playback.  Leave it off for reproducible runs.
+ *
+ * Recommended Usage:
+ *   CallbackWatchdog::configure(500.0, BUDGET_KILL);    // before the run
+ *   ...
+ *   CallbackWatchdog::overruns()                        // how often it fired
+ */
+enum BudgetPolicy {
+  BUDGET_THROTTLE,
+  BUDGET_KILL
+};
+
+class LifeForm;
+
+/* kill the LifeForm an event or callback ran for, if it is alive
+   (LifeForm.cpp) */
+void kill_target(const void* target);
+
+class CallbackWatchdog {
+  struct Settings {
+    uint64_t budget_ticks;
+    BudgetPolicy policy;
+    double throttle_delay;
+    double throttle_period;
+  };
+
+  static Settings& settings(void) {
+    static Settings s = { uint64_t(1000.0e-6 * CycleClock::ticks_per_second()),
+                          BUDGET_THROTTLE, 1.0, 10.0 };
+    return s;
+  }
+
+  /* (species ids beyond the registry's reserve are never throttled) */
+  static const unsigned max_species = 4096;
+
+  static std::atomic<double>* throttled_until(void) {
+    static std::atomic<double> until[max_species];
+    return until;
+  }
+
+  static std::atomic<uint64_t>& overrun_count(void) {
+    static std::atomic<uint64_t> count(0);
+    return count;
+  }
+
+public:
+  class Scope;
+
+private:
+  static Scope*& current(void) {
+    static thread_local Scope* scope = nullptr;
+    return scope;
+  }
+
+public:
+  /*
+   * Scope puts one call into species code under the watchdog.  'who'
+   * points at the 'n' LifeForms it runs for (an Event's target, or the
+   * objects of a batch call).  'when' is the simulated time it runs at.
+   * Species 0 (not a species' call) is never over budget.
+   */
+  class Scope {
+    LifeForm* const* who;
+    size_t n;
+    SpeciesId species;
+    double when;
+    uint64_t start;
+    uint64_t limit;
+    Scope* outer;
+    bool over;
+    bool may_kill;
+
+    friend class CallbackWatchdog;
+
+  public:
+    Scope(LifeForm* const* who, size_t n, SpeciesId species, double when,
+          bool may_kill = true)
+      : who(who), n(n), species(species), when(when), start(CycleClock::now()),
+        limit(settings().budget_ticks * (n ? n : 1)), outer(current()), over(false),
+        may_kill(may_kill) {
+      current() = this;
+    }
+
+    ~Scope(void) {
+      check();
+      current() = outer;
+      if (over && may_kill && settings().policy == BUDGET_KILL)
+        for (size_t k = 0; k < n; k += 1) kill_target(who[k]);
+    }
+
+    /* true once this call has used up its budget */
+    bool check(void) {
+      if (over || species == 0) return over;
+      if (CycleClock::now() - start <= limit) return false;
+      over = true;
+      overrun_count() += 1;
+      if (species < max_species)
+        throttled_until()[species].store(when + settings().throttle_period,
+                                         std::memory_order_relaxed);
+      return true;
+    }
+
+  private:
+    Scope(const Scope&) = delete;
+    void operator=(const Scope&) = delete;
+  };
+
+  static void configure(double budget_us, BudgetPolicy policy,
+                        double throttle_delay = 1.0, double throttle_period = 10.0) {
+    Settings& s = settings();
+    s.budget_ticks = uint64_t(budget_us * 1.0e-6 * CycleClock::ticks_per_second());
+    s.policy = policy;
+    s.throttle_delay = throttle_delay;
+    s.throttle_period = throttle_period;
+  }
+
+  /* called by the engine entry points: true if the species code that is
+     running (if any) has overrun, and the call should be refused */
+  static bool check(void) {
+    Scope* s = current();
+    return s != nullptr && s->check();
+  }
+
+  /* the delay to give an event (or WakeTimer action) with this tag created
+     now.  Only species tags (EventProfiler::is_species_tag) are delayed:
+     the engine's own events keep their times */
+  template <typename T>
+  static T adjust_delay(T delta, EventTag tag) {
+    if (!EventProfiler::is_species_tag(tag)) return delta;
+    Scope* s = current();
+    if (s == nullptr || s->species == 0) return delta;
+    bool throttled = s->over || (s->species < max_species &&
+      throttled_until()[s->species].load(std::memory_order_relaxed) > s->when);
+    if (throttled && delta < T(settings().throttle_delay)) return T(settings().throttle_delay);
+    return delta;
+  }
+
+  static uint64_t overruns(void) { return overrun_count().load(); }
+};
+
+#endif /* !(_CallbackBudget_h) */
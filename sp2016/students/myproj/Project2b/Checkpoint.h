@@ -0,0 +1,674 @@
+#if !(_Checkpoint_h)
+#define _Checkpoint_h 1
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "LifeForm.h"
+#include "Event.h"
+#include "QuadTree.h"
+#include "Random.h"
+
+/*
+ * Binary checkpoints of the complete simulation state.
+ *
+ * A checkpoint holds
+ *   - the simulation clock (Event::now()) and the event sequence counter
+ *   - the state of the random number generator, and the seed and next
+ *     serial of the counter-based draws (Philox.h)
+ *   - the names of the registered species (LifeForm::istream_creators)
+ *   - every live LifeForm: species, serial, energy, position, course, speed,
+ *     update and reproduce times, plus whatever the species itself saves
+ *     through LifeForm::save_state
+ *   - every pending (active) Event: its handler (the name of its tag), the
+ *     LifeForm it belongs to, the value its handler captured, its time and
+ *     its sequence number
+ *
+ * Handlers are std::function objects, so they cannot be written to a file.
+ * Instead, every kind of handler registers a Rebinder under its tag name.
+ * When the checkpoint is restored, the rebinder is called to recreate the
+ * Event exactly as the simulator would have (and to store it in whatever
+ * member the LifeForm uses to remember it), e.g. in LifeForm.cpp
+ *
+ *   Checkpoint::register_handler("border_cross",
+ *     [](LifeForm* lf, double, SimTime delta) {
+ *       lf->border_cross_event = (new Event(delta, [lf]() { lf->border_cross(); },
+ *                                          EVENT_BORDER_CROSS))->set_target(lf);
+ *       return lf->border_cross_event;
+ *     });
+ *
+ * An event that belongs to an object is rebound by "<species>::<tag>" if
+ * that is registered, and by "<tag>" otherwise.  Engine tags that every
+ * species uses for its own handler (hunt) need the per-species name:
+ *
+ *   Checkpoint::register_handler("Craig::hunt", ...);
+ *   Checkpoint::register_handler("wf2796::hunt", ...);
+ *
+ * A WakeTimer's actions (WakeTimer.h) are saved one by one, by tag and
+ * deadline, and its wakeup event with them.  They are rebuilt through
+ * action rebinders, found in the same way, which schedule the action
+ * again (and store its Handle wherever the object keeps it); LifeForm.cpp
+ * registers the engine's, e.g.
+ *
+ *   Checkpoint::register_action("lazy_death", [](LifeForm* lf, SimTime delta) {
+ *     lf->death_action = lf->timers.schedule(delta, death_tag, [lf]() { lf->die(); });
+ *     return lf->death_action;
+ *   });
+ *
+ * (a death prediction that stopped short, see LazyEnergy.h, is scheduled
+ * under a tag of its own, whose rebinder predicts again instead).
+ *
+ * With LAZY_ENERGY each object's energy is settled before it is saved, and
+ * its EnergyAccount (the periodic streams and their next ticks) is saved
+ * with it; its predicted death is one of its WakeTimer actions.  A
+ * checkpoint restores only into a simulator with the same LAZY_ENERGY
+ * setting.
+ *
+ * With MEAN_FIELD_ALGAE the mean field's cells (the folded algae: where
+ * each one is, its energy offset, and the cell's EnergyAccount) are saved
+ * after the LifeForms, as they are; saving wakes nothing.  The same goes
+ * for the MEAN_FIELD_ALGAE setting as for LAZY_ENERGY.
+ *
+ * (A coroutine's pending step, see Behavior.h, cannot be rebuilt: a world
+ * with a Behavior suspended in it cannot be saved.)
+ *
+ * save() fails (and writes nothing) if a pending event or action has no
+ * rebinder, rather than writing a checkpoint that cannot be restored.
+ *
+ * restore() must be called on an empty world (before create_life).  It
+ * reads and checks the whole checkpoint first: one that is damaged, or
+ * has an object, event or action that cannot be restored, is refused with
+ * the world left as it was.  The LifeForms are put back into 'space'
+ * directly (without any resize callbacks) and the events are inserted
+ * with their original times and sequence numbers, so a resumed run
+ * produces exactly the same results as an uninterrupted one.  The events
+ * the species' constructors schedule are deleted, and every pointer to
+ * them forgotten (forget_events), before the checkpoint's events are
+ * rebound.
+ */
+
+class CheckpointWriter {
+  std::ostream& out;
+public:
+  explicit CheckpointWriter(std::ostream& out) : out(out) {}
+
+  template <typename T>
+  void put(const T& x) {
+    static_assert(std::is_trivially_copyable<T>::value, "put is for plain data");
+    out.write(reinterpret_cast<const char*>(&x), sizeof(T));
+  }
+
+  void put_string(const std::string& s) {
+    put<uint32_t>(s.size());
+    out.write(s.data(), s.size());
+  }
+
+  bool ok(void) const { return bool(out); }
+};
+
+class CheckpointReader {
+  std::istream& in;
+public:
+  explicit CheckpointReader(std::istream& in) : in(in) {}
+
+  template <typename T>
+  T get(void) {
+    static_assert(std::is_trivially_copyable<T>::value, "get is for plain data");
+    T x;
+    in.read(reinterpret_cast<char*>(&x), sizeof(T));
+    return x;
+  }
+
+  std::string get_string(void) {
+    uint32_t len = get<uint32_t>();
+    std::string s(ok() ? len : 0, '\0');
+    if (len > 0 && ok()) in.read(&s[0], len);
+    return s;
+  }
+
+  bool ok(void) const { return bool(in); }
+};
+
+class Checkpoint {
+public:
+  /* recreate an event for 'target' that will occur 'delta' time units from
+     now.  The rebinder must return the new Event */
+  using Rebinder = std::function<Event*(LifeForm* target, double arg, SimTime delta)>;
+
+  /* schedule a WakeTimer action for 'target' 'delta' time units from now.
+     The rebinder must return its Handle */
+  using ActionRebinder = std::function<WakeTimer::Handle(LifeForm* target, SimTime delta)>;
+
+  static const uint32_t version = 5;  // 2: serials and the draw_uniform seed
+                                      // 3: WakeTimer actions
+                                      // 4: LAZY_ENERGY accounts
+                                      // 5: the mean field (MEAN_FIELD_ALGAE)
+
+  static void register_handler(const std::string& tag_name, Rebinder r) {
+    rebinders()[tag_name] = r;
+  }
+
+  static void register_action(const std::string& tag_name, ActionRebinder r) {
+    action_rebinders()[tag_name] = r;
+  }
+
+  static bool save(std::ostream& out);
+  static bool restore(std::istream& in);
+
+private:
+  friend class WorldSnapshot;   // shares the rebinders and the random state
+
+  static std::map<std::string, Rebinder>& rebinders(void) {
+    static std::map<std::string, Rebinder> table;
+    return table;
+  }
+
+  static std::map<std::string, ActionRebinder>& action_rebinders(void) {
+    static std::map<std::string, ActionRebinder> table;
+    return table;
+  }
+
+  /* the rebinder of an event (or action) with this tag name whose target
+     is of this species ("" for none): "<species>::<tag>" if registered,
+     else "<tag>", else null */
+  template <typename R>
+  static const R* find_rebinder(const std::map<std::string, R>& table,
+                                const std::string& tag_name, const std::string& species) {
+    if (!species.empty()) {
+      auto p = table.find(species + "::" + tag_name);
+      if (p != table.end()) return &p->second;
+    }
+    auto p = table.find(tag_name);
+    return p != table.end() ? &p->second : nullptr;
+  }
+  static const Rebinder* rebinder_for(const std::string& tag_name, const LifeForm* target) {
+    return find_rebinder(rebinders(), tag_name, target ? target->species_name() : std::string());
+  }
+  static const ActionRebinder* action_rebinder_for(const std::string& tag_name,
+                                                   const LifeForm* target) {
+    return find_rebinder(action_rebinders(), tag_name,
+                         target ? target->species_name() : std::string());
+  }
+
+  /* a saved wakeup: the restored timer's wakeup takes its time and
+     sequence number */
+  struct SavedWakeup {
+    LifeForm* owner;
+    SimTime t;
+    uint64_t seq;
+  };
+  static void restore_wakeups(const std::vector<SavedWakeup>& wakeups) {
+    for (const SavedWakeup& w : wakeups) {
+      Event* e = w.owner->timers.wakeup;
+      if (e == nullptr || e->in_queue) continue;  // (a stale wakeup: dropped)
+      e->t = w.t;
+      e->seq = w.seq;
+      w.owner->timers.armed_at = w.t;
+    }
+  }
+
+  /* the events a new object's constructor scheduled are about to be
+     deleted: drop every pointer to them (the engine's and the species') */
+  static void forget_constructor_events(LifeForm* lf) {
+    lf->border_cross_event = nullptr;
+    lf->timers.forget();
+#if LAZY_ENERGY
+    lf->death_action = 0;
+#endif /* LAZY_ENERGY */
+    lf->forget_events();
+  }
+
+  static const char* magic(void) { return "EPLCKPT"; } // 8 bytes with the NUL
+
+  /* 1 if objects carry an EnergyAccount (LAZY_ENERGY) */
+  static uint8_t energy_model(void) {
+#if LAZY_ENERGY
+    return 1;
+#else
+    return 0;
+#endif /* LAZY_ENERGY */
+  }
+
+  /* 1 if folded algae are kept in the mean field (MEAN_FIELD_ALGAE) */
+  static uint8_t field_model(void) {
+#if MEAN_FIELD_ALGAE
+    return 1;
+#else
+    return 0;
+#endif /* MEAN_FIELD_ALGAE */
+  }
+
+  static void save_random(CheckpointWriter& w) {
+#if defined (_MSC_VER)
+    std::ostringstream state;
+    state << epl::random_generator;
+    w.put_string(state.str());
+#else
+    unsigned short state[3];
+    if (world_rng_state() != nullptr) {
+      memcpy(state, world_rng_state(), sizeof(state));
+    }
+    else {
+      unsigned short zero[3] = { 0, 0, 0 };
+      memcpy(state, seed48(zero), sizeof(state));
+      seed48(state);            // put the generator back the way it was
+    }
+    for (unsigned k = 0; k < 3; k += 1) w.put<uint16_t>(state[k]);
+#endif
+  }
+
+  /* read what save_random wrote, to be put back later (restore_random
+     on a reader of the returned bytes) */
+  static std::string read_random(CheckpointReader& r) {
+    std::ostringstream bytes;
+    CheckpointWriter w(bytes);
+#if defined (_MSC_VER)
+    w.put_string(r.get_string());
+#else
+    for (unsigned k = 0; k < 3; k += 1) w.put<uint16_t>(r.get<uint16_t>());
+#endif
+    return bytes.str();
+  }
+
+  static void restore_random(CheckpointReader& r) {
+#if defined (_MSC_VER)
+    std::istringstream state(r.get_string());
+    state >> epl::random_generator;
+#else
+    unsigned short state[3];
+    for (unsigned k = 0; k < 3; k += 1) state[k] = r.get<uint16_t>();
+    if (world_rng_state() != nullptr) memcpy(world_rng_state(), state, sizeof(state));
+    else seed48(state);
+#endif
+  }
+};
+
+inline bool Checkpoint::save(std::ostream& out) {
+  /* LifeForms, in all_life order */
+  std::unordered_map<const void*, int64_t> index;
+  std::vector<LifeForm*> alive;
+  for (LifeForm* lf : LifeForm::all_life()) {
+    if (!lf->is_alive) continue;
+    index[lf] = alive.size();
+    alive.push_back(lf);
+#if LAZY_ENERGY
+    lf->sync_energy();          // (every tick up to now applied)
+#endif /* LAZY_ENERGY */
+  }
+
+  /* pending events, in the order they will occur */
+  std::vector<Event*> pending;
+  Event::for_each_pending([&pending](Event* e) {
+    if (e->active) pending.push_back(e);
+  });
+  std::sort(pending.begin(), pending.end(), [](const Event* a, const Event* b) {
+    return a->t < b->t || (a->t == b->t && a->seq < b->seq);
+  });
+
+  /* every event and action that is saved must be restorable */
+  uint32_t num_saved = 0;
+  bool restorable = true;
+  for (Event* e : pending) {
+    if (e->target != nullptr && !index.count(e->target)) continue;
+    num_saved += 1;
+    if (e->tag == EVENT_WAKEUP) continue;       // (rebuilt with the actions)
+    const LifeForm* target = e->target;
+    std::string name = EventProfiler::tag_name(e->tag);
+    if (rebinder_for(name, target) == nullptr) {
+      std::cerr << "checkpoint: no rebinder for a pending \"" << name << "\" event"
+                << (target ? " of a " + target->species_name() : std::string()) << "\n";
+      restorable = false;
+    }
+  }
+  uint64_t num_actions = 0;
+  for (LifeForm* lf : alive) {
+    for (const WakeTimer::Pending& a : lf->timers.pending) {
+      num_actions += 1;
+      std::string name = EventProfiler::tag_name(a.tag);
+      if (action_rebinder_for(name, lf) == nullptr) {
+        std::cerr << "checkpoint: no rebinder for a pending \"" << name << "\" action of a "
+                  << lf->species_name() << "\n";
+        restorable = false;
+      }
+    }
+  }
+  if (!restorable) return false;
+  if (num_saved != pending.size())
+    std::cerr << "checkpoint: " << pending.size() - num_saved
+              << " events belong to dead objects and were not saved\n";
+
+  CheckpointWriter w(out);
+  out.write(magic(), 8);
+  w.put<uint32_t>(version);
+  w.put<int64_t>(SimTime::ticks_per_unit); // 0 for double time
+  w.put<uint8_t>(energy_model());
+  w.put<uint8_t>(field_model());
+  w.put<SimTime>(Event::now());
+  w.put<uint64_t>(Event::sequence_counter());
+  save_random(w);
+  w.put<uint64_t>(LifeForm::world_seed());
+  w.put<uint64_t>(LifeForm::habitat().next_serial);
+
+  LFCreatorTable& creators = LifeForm::istream_creators();
+  w.put<uint32_t>(creators.size());
+  for (auto& c : creators) w.put_string(c.first);
+
+  w.put<uint32_t>(alive.size());
+  for (LifeForm* lf : alive) {
+    w.put_string(lf->species_name());
+    w.put<uint64_t>(lf->serial);
+    w.put<double>(lf->hot_energy());
+    w.put<double>(lf->hot_position().xpos);
+    w.put<double>(lf->hot_position().ypos);
+    w.put<double>(lf->hot_update_time());
+    w.put<double>(lf->reproduce_time);
+    w.put<double>(lf->hot_course());
+    w.put<double>(lf->hot_speed());
+    w.put<double>(lf->start_point.xpos);
+    w.put<double>(lf->start_point.ypos);
+#if LAZY_ENERGY
+    w.put<EnergyAccount>(lf->account);
+#endif /* LAZY_ENERGY */
+
+    std::ostringstream extra;
+    CheckpointWriter species_writer(extra);
+    lf->save_state(species_writer);
+    w.put_string(extra.str());
+  }
+#if MEAN_FIELD_ALGAE
+  LifeForm::habitat().field.save(w);      // (the folded algae, as they are)
+#endif /* MEAN_FIELD_ALGAE */
+
+  std::vector<std::string> tag_names;
+  std::map<EventTag, uint32_t> tag_index;
+  auto name_tag = [&tag_names, &tag_index](EventTag tag) {
+    if (tag_index.count(tag)) return;
+    tag_index[tag] = tag_names.size();
+    tag_names.push_back(EventProfiler::tag_name(tag));
+  };
+  for (Event* e : pending) name_tag(e->tag);
+  for (LifeForm* lf : alive)
+    for (const WakeTimer::Pending& a : lf->timers.pending) name_tag(a.tag);
+  w.put<uint32_t>(tag_names.size());
+  for (const std::string& name : tag_names) w.put_string(name);
+
+  w.put<uint32_t>(num_saved);
+  for (Event* e : pending) {
+    if (e->target != nullptr && !index.count(e->target)) continue;
+    w.put<uint32_t>(tag_index[e->tag]);
+    w.put<int64_t>(e->target ? index[e->target] : -1);
+    w.put<double>(e->arg);
+    w.put<SimTime>(e->t);
+    w.put<uint64_t>(e->seq);
+  }
+
+  /* each object's actions, in the order they will run */
+  w.put<uint64_t>(num_actions);
+  for (size_t k = 0; k < alive.size(); k += 1) {
+    for (const WakeTimer::Pending& a : alive[k]->timers.pending) {
+      w.put<uint32_t>(tag_index[a.tag]);
+      w.put<int64_t>(k);
+      w.put<SimTime>(a.when);
+    }
+  }
+  return w.ok();
+}
+
+inline bool Checkpoint::restore(std::istream& in) {
+  CheckpointReader r(in);
+  char header[8];
+  in.read(header, 8);
+  if (!in || memcmp(header, magic(), 8) != 0) {
+    std::cerr << "checkpoint: not a checkpoint file\n";
+    return false;
+  }
+  if (r.get<uint32_t>() != version) {
+    std::cerr << "checkpoint: unsupported version\n";
+    return false;
+  }
+  if (r.get<int64_t>() != SimTime::ticks_per_unit) {
+    std::cerr << "checkpoint: written with a different SimTime representation\n";
+    return false;
+  }
+  if (r.get<uint8_t>() != energy_model()) {
+    std::cerr << "checkpoint: written with a different LAZY_ENERGY setting\n";
+    return false;
+  }
+  if (r.get<uint8_t>() != field_model()) {
+    std::cerr << "checkpoint: written with a different MEAN_FIELD_ALGAE setting\n";
+    return false;
+  }
+  assert(LifeForm::all_life().empty() && Event::num_events() == 0);
+
+  /* read and check the whole checkpoint before changing anything, so
+     that a checkpoint that is refused leaves the world empty */
+  SimTime now = r.get<SimTime>();
+  uint64_t next_seq = r.get<uint64_t>();
+  std::string saved_random = read_random(r);
+  uint64_t seed = r.get<uint64_t>();
+  uint64_t next_serial = r.get<uint64_t>();
+
+  LFCreatorTable& creators = LifeForm::istream_creators();
+  uint32_t num_species = r.get<uint32_t>();
+  for (uint32_t k = 0; k < num_species && r.ok(); k += 1) {
+    std::string name = r.get_string();
+    if (!creators.count(name))
+      std::cerr << "checkpoint: species " << name << " is not registered\n";
+  }
+
+  struct SavedObject {
+    std::string species;
+    uint64_t serial;
+    double energy, xpos, ypos, update_time, reproduce_time, course, speed;
+    Point start_point;
+#if LAZY_ENERGY
+    EnergyAccount account;
+#endif /* LAZY_ENERGY */
+    std::string extra;          // what save_state wrote
+  };
+  /* (the counts are not trusted: a damaged one runs into the end of the
+     stream) */
+  std::vector<SavedObject> saved;
+  uint32_t num_objects = r.get<uint32_t>();
+  for (uint32_t k = 0; k < num_objects && r.ok(); k += 1) {
+    SavedObject o;
+    o.species = r.get_string();
+    o.serial = r.get<uint64_t>();
+    o.energy = r.get<double>();
+    o.xpos = r.get<double>();
+    o.ypos = r.get<double>();
+    o.update_time = r.get<double>();
+    o.reproduce_time = r.get<double>();
+    o.course = r.get<double>();
+    o.speed = r.get<double>();
+    o.start_point.xpos = r.get<double>();
+    o.start_point.ypos = r.get<double>();
+#if LAZY_ENERGY
+    o.account = r.get<EnergyAccount>();
+#endif /* LAZY_ENERGY */
+    o.extra = r.get_string();
+    saved.push_back(o);
+  }
+#if MEAN_FIELD_ALGAE
+  MeanFieldAlgae field;
+  if (!field.restore(r)) {
+    std::cerr << "checkpoint: the mean field is damaged\n";
+    return false;
+  }
+#endif /* MEAN_FIELD_ALGAE */
+
+  std::vector<std::string> tag_names;
+  uint32_t num_tags = r.get<uint32_t>();
+  for (uint32_t k = 0; k < num_tags && r.ok(); k += 1) tag_names.push_back(r.get_string());
+
+  struct SavedEvent {
+    uint32_t tag;
+    int64_t target;
+    double arg;
+    SimTime t;
+    uint64_t seq;
+  };
+  std::vector<SavedEvent> events;
+  uint32_t num_events = r.get<uint32_t>();
+  for (uint32_t k = 0; k < num_events && r.ok(); k += 1) {
+    SavedEvent e;
+    e.tag = r.get<uint32_t>();
+    e.target = r.get<int64_t>();
+    e.arg = r.get<double>();
+    e.t = r.get<SimTime>();
+    e.seq = r.get<uint64_t>();
+    events.push_back(e);
+  }
+
+  struct SavedAction {
+    uint32_t tag;
+    int64_t target;
+    SimTime when;
+  };
+  std::vector<SavedAction> actions;
+  uint64_t num_actions = r.get<uint64_t>();
+  for (uint64_t k = 0; k < num_actions && r.ok(); k += 1) {
+    SavedAction a;
+    a.tag = r.get<uint32_t>();
+    a.target = r.get<int64_t>();
+    a.when = r.get<SimTime>();
+    actions.push_back(a);
+  }
+  if (!r.ok()) {
+    std::cerr << "checkpoint: the checkpoint is damaged\n";
+    return false;
+  }
+
+  /* every object can be created, and every event and action has a
+     rebinder (per species first, see find_rebinder) */
+  for (size_t k = 0; k < saved.size(); k += 1) {
+    if (!creators.count(saved[k].species) ||
+        LifeForm::space().is_out_of_bounds(Point(saved[k].xpos, saved[k].ypos))) {
+      std::cerr << "checkpoint: cannot create object " << k << " (a " << saved[k].species << ")\n";
+      return false;
+    }
+  }
+  const std::string wakeup_name = EventProfiler::tag_name(EVENT_WAKEUP);
+  auto species_of = [&saved](int64_t object) {
+    return object >= 0 ? saved[object].species : std::string();
+  };
+  std::vector<const Rebinder*> rebind(events.size(), nullptr);
+  for (size_t k = 0; k < events.size(); k += 1) {
+    const SavedEvent& e = events[k];
+    bool ok = e.tag < tag_names.size() && e.target >= -1 && e.target < int64_t(saved.size());
+    if (ok && e.target >= 0 && tag_names[e.tag] == wakeup_name) continue;
+    if (ok) rebind[k] = find_rebinder(rebinders(), tag_names[e.tag], species_of(e.target));
+    if (rebind[k] == nullptr) {
+      std::cerr << "checkpoint: cannot restore event " << k << "\n";
+      return false;
+    }
+  }
+  std::vector<const ActionRebinder*> action_rebind(actions.size(), nullptr);
+  for (size_t k = 0; k < actions.size(); k += 1) {
+    const SavedAction& a = actions[k];
+    if (a.tag < tag_names.size() && a.target >= 0 && a.target < int64_t(saved.size()))
+      action_rebind[k] = find_rebinder(action_rebinders(), tag_names[a.tag],
+                                       species_of(a.target));
+    if (action_rebind[k] == nullptr) {
+      std::cerr << "checkpoint: cannot restore action " << k << "\n";
+      return false;
+    }
+  }
+
+  Event::state().now = now;
+  LifeForm::habitat().seed = seed;
+
+  /* events scheduled by the species' constructors are replaced by the
+     events in the checkpoint, so stage them instead of queueing them */
+  std::vector<Event*> discarded;
+  Event::staged_events() = &discarded;
+
+  std::vector<LifeForm*> objects;
+  objects.reserve(saved.size());
+  for (const SavedObject& o : saved) {
+    SmartPointer<LifeForm> obj = creators[o.species]();
+    LifeForm* lf = &*obj;
+    lf->serial = o.serial;
+    lf->hot_energy() = o.energy;
+    lf->set_hot_position(Point(o.xpos, o.ypos));
+    lf->hot_update_time() = o.update_time;
+    lf->reproduce_time = o.reproduce_time;
+    lf->hot_course() = o.course;
+    lf->hot_speed() = o.speed;
+    lf->start_point = o.start_point;
+#if LAZY_ENERGY
+    lf->account = o.account;
+#endif /* LAZY_ENERGY */
+    lf->is_alive = true;
+    forget_constructor_events(lf);
+
+    std::istringstream extra(o.extra);
+    CheckpointReader species_reader(extra);
+    lf->restore_state(species_reader);
+
+    LifeForm::space().insert_quiet(obj, lf->hot_position(), [lf]() { lf->region_resize(); });
+    objects.push_back(lf);
+  }
+
+  /* the species' constructors may draw random numbers: the saved state
+     is put in once they have run */
+  std::istringstream random_again(saved_random);
+  CheckpointReader random_reader(random_again);
+  restore_random(random_reader);
+#if MEAN_FIELD_ALGAE
+  LifeForm::habitat().field = std::move(field);   // (before its sweep is rebound)
+#endif /* MEAN_FIELD_ALGAE */
+
+  std::vector<Event*> restored;
+  std::vector<SavedWakeup> wakeups;
+  Event::staged_events() = &restored;
+  for (size_t k = 0; k < events.size(); k += 1) {
+    const SavedEvent& saved_event = events[k];
+    LifeForm* owner = saved_event.target >= 0 ? objects[saved_event.target] : nullptr;
+    if (rebind[k] == nullptr) {                 // (a wakeup: rebuilt with the actions)
+      wakeups.push_back({ owner, saved_event.t, saved_event.seq });
+      continue;
+    }
+    size_t before = restored.size();
+    Event* e = (*rebind[k])(owner, saved_event.arg, saved_event.t - Event::now());
+    if (restored.size() != before + 1 || restored.back() != e) {
+      /* (a rebinder that breaks its contract cannot be found out before
+         it runs) */
+      std::cerr << "checkpoint: the rebinder of \"" << tag_names[saved_event.tag]
+                << "\" must schedule exactly one event and return it\n";
+      Event::staged_events() = nullptr;
+      return false;
+    }
+    e->t = saved_event.t;       // exactly, not now + delta
+    e->seq = saved_event.seq;
+  }
+  for (size_t k = 0; k < actions.size(); k += 1) {
+    LifeForm* owner = objects[actions[k].target];
+    owner->timers.restore_deadline((*action_rebind[k])(owner, actions[k].when - Event::now()),
+                                   actions[k].when);
+  }
+  restore_wakeups(wakeups);
+  Event::staged_events() = nullptr;
+
+  Event::sequence_counter() = next_seq;
+  for (Event* e : restored) {
+    if (e->seq == 0) e->seq = Event::sequence_counter()++;  // (a wakeup not saved)
+    e->insert();
+  }
+  for (Event* e : discarded) delete e;   // (nothing refers to them now)
+  LifeForm::habitat().next_serial = next_serial;
+  return true;
+}
+
+#endif /* !(_Checkpoint_h) */
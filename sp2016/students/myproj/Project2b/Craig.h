@@ -19,6 +19,7 @@ public:
   static SmartPointer<LifeForm> create(void);
   virtual std::string species_name(void) const;
   virtual Action encounter(const ObjInfo&);
+  void forget_events(void) { hunt_event = nullptr; }
   friend class Initializer<Craig>;
 };
 
@@ -0,0 +1,62 @@
+#if !(_CycleClock_h)
+#define _CycleClock_h 1
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+# include <intrin.h>
+# define CYCLE_CLOCK_TSC 1
+#elif (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+# include <x86intrin.h>
+# define CYCLE_CLOCK_TSC 1
+#endif
+
+/*
+ * Class name: CycleClock
+ * Description:
+ *  The cheapest clock there is for timing short calls.  On x86 it reads
+ *  the time stamp counter (rdtsc, which counts at a constant rate on every
+ *  processor of the last decade).  Elsewhere it falls back to
+ *  steady_clock nanoseconds.  now() is in ticks.  ticks_per_second() is
+ *  measured once, on first use, against steady_clock (about 20ms).
+ *
+ *  rdtsc is not a serializing instruction, so a single reading can be off
+ *  by a few dozen cycles.  That is noise for anything worth accounting
+ *  for.
+ */
+class CycleClock {
+public:
+  static uint64_t now(void) {
+#if CYCLE_CLOCK_TSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif /* CYCLE_CLOCK_TSC */
+  }
+
+  static double ticks_per_second(void) {
+    static const double rate = calibrate();
+    return rate;
+  }
+
+  static double seconds(uint64_t ticks) { return ticks / ticks_per_second(); }
+
+private:
+  static double calibrate(void) {
+#if CYCLE_CLOCK_TSC
+    auto wall0 = std::chrono::steady_clock::now();
+    uint64_t tick0 = now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto wall1 = std::chrono::steady_clock::now();
+    uint64_t tick1 = now();
+    double elapsed = std::chrono::duration<double>(wall1 - wall0).count();
+    return elapsed > 0.0 ? (tick1 - tick0) / elapsed : 1.0e9;
+#else
+    return 1.0e9;
+#endif /* CYCLE_CLOCK_TSC */
+  }
+};
+
+#endif /* !(_CycleClock_h) */
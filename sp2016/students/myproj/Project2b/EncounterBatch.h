@@ -0,0 +1,254 @@
+#if !(_EncounterBatch_h)
+#define _EncounterBatch_h 1
+
+#if PARALLEL_ENCOUNTERS
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "EventBatch.h"
+#include "LifeForm.h"
+#include "World.h"
+#include "ObjInfo.h"
+#include "Params.h"
+#include "Replay.h"
+#include "SpeciesBatch.h"
+
+/*
+ * Parallel encounter resolution (PARALLEL_ENCOUNTERS).
+ *
+ * Normally check_encounter calls resolve_encounter on the spot.  With
+ * PARALLEL_ENCOUNTERS it calls EncounterBatch::add instead, and the pairs
+ * that come up within encounter_window of the first one are resolved
+ * together by a single flush event:
+ *
+ *  1. the pairs are split into rounds with assign_batch_rounds (the same
+ *     grid test run_event_batch uses), using a footprint that covers both
+ *     objects.  Pairs in one round share no grid cell, and therefore no
+ *     object.
+ *  2. the pairs of a round are *decided*: both sides of every pair are
+ *     asked what they want to do through SpeciesBatch::encounters, one
+ *     encounter_batch call per species, run in parallel on a WorkPool.  Then
+ *     the eat_success_chance draws are made.  Deciding only reads the
+ *     world.
+ *  3. the decisions are *applied* on the calling thread, in the order the
+ *     pairs were added: both sides pay encounter_penalty, and the winner
+ *     (if any) eats the loser, which schedules its digestion as usual.
+ *     The next round is decided after this round has been applied.
+ *
+ * Random draws come from a small generator per pair, seeded from one
+ * replay_drand48 draw per flush and the pair's position in the batch.  Which
+ * thread decides a pair therefore does not matter: a run is repeatable
+ * for a given seed with any number of threads.
+ *
+ * A pair is resolved as it was found: both objects were within
+ * encounter_distance when check_encounter saw them.  If they have moved
+ * apart by the flush, the pair is still resolved, and counted in
+ * totals().drifted; only a pair one of whose objects has died since is
+ * dropped (counted in totals().expired).
+ *
+ * The encounter() (and encounter_batch) callbacks of different species run
+ * concurrently only for species that say they may (LifeForm::parallel_safe);
+ * every other species is asked on the simulation's thread, as without
+ * PARALLEL_ENCOUNTERS.
+ */
+
+/* pairs that come up less than this long after the first pending pair are
+   resolved together (so an encounter is resolved at most this late) */
+const SimTime encounter_window = 0.01;
+
+/*
+ * Class name: EncounterRng
+ * Description:
+ *  splitmix64; one stream per pair
+ */
+class EncounterRng {
+  uint64_t state;
+
+public:
+  explicit EncounterRng(uint64_t seed) : state(seed) {}
+
+  uint64_t next(void) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  /* uniform in [0, 1) */
+  double uniform(void) { return double(next() >> 11) * (1.0 / 9007199254740992.0); }
+};
+
+class EncounterBatch {
+public:
+  struct Pair {
+    SmartPointer<LifeForm> a, b;
+  };
+
+  struct Outcome {
+    bool valid;                 // both still alive
+    int eater;                  // -1: nobody eats, 0: a eats b, 1: b eats a
+  };
+
+  struct Totals {
+    uint64_t pairs;             // pairs added
+    uint64_t drifted;           // resolved although apart by the flush
+    uint64_t expired;           // dropped: one side died before the flush
+  };
+
+private:
+  std::vector<Pair> pairs;      // in the order they were added
+  std::set<std::pair<const LifeForm*, const LifeForm*>> seen;  // pairs already added
+  bool flush_pending;
+  Totals totals_so_far;
+
+  EncounterBatch(void) : flush_pending(false), totals_so_far{ 0, 0, 0 } {}
+
+  /* the World's pending pairs and its pool (in LifeForm::Habitat, so
+     nothing outlives the World or leaks into the next one) */
+  static EncounterBatch& pending(void) {
+    std::shared_ptr<EncounterBatch>& batch = LifeForm::habitat().encounters;
+    if (!batch) batch.reset(new EncounterBatch);
+    return *batch;
+  }
+
+  static WorkPool& pool(void) {
+    std::shared_ptr<WorkPool>& workers = LifeForm::habitat().workers;
+    if (!workers) workers = std::make_shared<WorkPool>();
+    return *workers;
+  }
+
+  static std::pair<const LifeForm*, const LifeForm*> pair_key(const LifeForm* a,
+                                                              const LifeForm* b) {
+    return b < a ? std::make_pair(b, a) : std::make_pair(a, b);
+  }
+
+  static bool eats(bool said_eat, double e_eater, double e_food, EncounterRng& rng) {
+    return said_eat && rng.uniform() < EngineParams::eat_success_chance(e_eater, e_food);
+  }
+
+  /* both sides succeeded: who gets the first bite */
+  static int tiebreak(LifeForm* a, LifeForm* b, double ea, double eb, EncounterRng& rng) {
+    switch (encounter_strategy) {
+    case BIG_GUY_WINS:     return ea >= eb ? 0 : 1;
+    case UNDERDOG_IS_HERE: return ea <= eb ? 0 : 1;
+    case FASTER_GUY_WINS:  return a->hot_speed() >= b->hot_speed() ? 0 : 1;
+    case SLOWER_GUY_WINS:  return a->hot_speed() <= b->hot_speed() ? 0 : 1;
+    case EVEN_MONEY:
+    default:               return rng.uniform() < 0.5 ? 0 : 1;
+    }
+  }
+
+  static bool still_meet(const Pair& p) {
+    return p.a->position().distance(p.b->position()) <= EngineParams::encounter_distance();
+  }
+
+  /* phase 2, once both sides have answered: reads the world only */
+  static Outcome decide(const Pair& p, Action a_does, Action b_does, EncounterRng& rng) {
+    Outcome o;
+    o.valid = true;
+    o.eater = -1;
+    LifeForm* a = &*p.a;
+    LifeForm* b = &*p.b;
+    double ea = a->health() * EngineParams::start_energy();   // (also right with LAZY_ENERGY)
+    double eb = b->health() * EngineParams::start_energy();
+    bool a_eats = eats(a_does == LIFEFORM_EAT, ea, eb, rng);
+    bool b_eats = eats(b_does == LIFEFORM_EAT, eb, ea, rng);
+    if (a_eats && b_eats) o.eater = tiebreak(a, b, ea, eb, rng);
+    else if (a_eats) o.eater = 0;
+    else if (b_eats) o.eater = 1;
+    return o;
+  }
+
+  /* phase 3 (sequential, in 'pairs' order) */
+  static void apply(const Pair& p, const Outcome& o) {
+    if (!o.valid) return;
+    LifeForm* a = &*p.a;
+    LifeForm* b = &*p.b;
+    a->lose_energy(EngineParams::encounter_penalty());
+    b->lose_energy(EngineParams::encounter_penalty());
+#if POPULATION_RECORDER
+    if (PopulationRecorder* rec = LifeForm::recorder()) rec->met(a->species_id(), b->species_id());
+#endif /* POPULATION_RECORDER */
+    if (o.eater == 0 && a->is_alive && b->is_alive) a->eat(p.b);
+    else if (o.eater == 1 && a->is_alive && b->is_alive) b->eat(p.a);
+  }
+
+public:
+  /* called by check_encounter (instead of resolve_encounter) */
+  static void add(SmartPointer<LifeForm> a, SmartPointer<LifeForm> b) {
+    EncounterBatch& batch = pending();
+    if (!batch.seen.insert(pair_key(&*a, &*b)).second) return;
+    batch.pairs.push_back(Pair{ a, b });
+    batch.totals_so_far.pairs += 1;
+    if (!batch.flush_pending) {
+      batch.flush_pending = true;
+      new Event(encounter_window, []() { flush(pool()); }, EVENT_ENCOUNTER);
+    }
+  }
+
+  /* the pairs added, drifted apart and expired so far (on this World) */
+  static const Totals& totals(void) { return pending().totals_so_far; }
+
+  /* resolve every pending pair.  Returns the number of pairs */
+  static unsigned flush(WorkPool& workers) {
+    EncounterBatch& batch = pending();
+    std::vector<Pair> todo;
+    todo.swap(batch.pairs);
+    batch.seen.clear();
+    batch.flush_pending = false;
+    if (todo.empty()) return 0;
+
+    uint64_t seed = uint64_t(replay_drand48() * 281474976710656.0);  // 2^48
+
+    std::vector<Footprint> where;
+    where.reserve(todo.size());
+    for (const Pair& p : todo) {
+      Point pa = p.a->position(), pb = p.b->position();
+      Point mid((pa.xpos + pb.xpos) / 2.0, (pa.ypos + pb.ypos) / 2.0);
+      where.push_back(Footprint(mid, pa.distance(pb) / 2.0 + EngineParams::encounter_distance()));
+    }
+    std::vector<unsigned> round;
+    unsigned num_rounds = assign_batch_rounds(where, round);
+
+    std::vector<Outcome> outcome(todo.size());
+    std::vector<size_t> members;
+    std::vector<LifeForm*> selves;  // a, b of each member pair in turn
+    std::vector<ObjInfo> them;
+    std::vector<Action> does;
+    for (unsigned r = 1; r <= num_rounds; r += 1) {
+      members.clear();
+      selves.clear();
+      them.clear();
+      for (size_t k = 0; k < todo.size(); k += 1) {
+        if (round[k] != r) continue;
+        outcome[k] = Outcome{ false, -1 };
+        if (!todo[k].a->is_alive || !todo[k].b->is_alive) {
+          batch.totals_so_far.expired += 1;
+          continue;
+        }
+        if (!still_meet(todo[k])) batch.totals_so_far.drifted += 1;
+        members.push_back(k);
+        selves.push_back(&*todo[k].a);
+        them.push_back(todo[k].a->info_about_them(todo[k].b));
+        selves.push_back(&*todo[k].b);
+        them.push_back(todo[k].b->info_about_them(todo[k].a));
+      }
+      does.assign(selves.size(), LIFEFORM_IGNORE);
+      SpeciesBatch::encounters(selves, them, does, &workers);
+
+      for (size_t m = 0; m < members.size(); m += 1) {
+        size_t k = members[m];
+        EncounterRng rng(seed ^ (uint64_t(k) * 0xd1b54a32d192ed03ULL));
+        outcome[k] = decide(todo[k], does[2 * m], does[2 * m + 1], rng);
+      }
+      for (size_t k : members) apply(todo[k], outcome[k]);
+    }
+    return todo.size();
+  }
+};
+
+#endif /* PARALLEL_ENCOUNTERS */
+#endif /* !(_EncounterBatch_h) */
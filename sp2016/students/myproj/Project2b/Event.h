@@ -2,14 +2,50 @@
 #define _Event_h 1
 
 #include <cassert>
+#include <cstdint>
 #include <functional>
 #include <limits.h>
+#include <vector>
 
 #include "Params.h"
 #include "SimTime.h"            // for the SimTime class
+#include "Footprint.h"
+#include "EventProfile.h"
+#if REPLAY_LOG
+#include "Replay.h"
+#endif /* REPLAY_LOG */
+#if SPECIES_PROFILING
+#include "SpeciesProfile.h"
+#endif /* SPECIES_PROFILING */
+#if CALLBACK_BUDGET
+#include "CallbackBudget.h"
+#endif /* CALLBACK_BUDGET */
 
-/* necessary forward reference */
+/* necessary forward references */
+class LifeForm;
 class PQueue;
+class WorkPool;
+class World;
+
+/*
+ * The event queue of one simulation.  A process has a default queue (used
+ * by single-world programs); every World has its own, and World::Bind
+ * makes it the queue of the calling thread (see World.h).
+ */
+struct EventQueueState {
+    PQueue* equeue;               // a priority queue of all events
+    SimTime now;
+    uint64_t next_seq;            // the sequence number of the next event
+    unsigned background = 0;      // pending housekeeping events (see
+                                  // Event::only_background)
+
+    EventQueueState(void);        // (Event.cpp) empty queue, now 0, next_seq 1
+    ~EventQueueState(void);       // (Event.cpp) release every remaining
+                                  // handler first, then delete the events
+  private:
+    EventQueueState(const EventQueueState&) = delete;
+    void operator=(const EventQueueState&) = delete;
+};
 
 /*
  * Class name: Event
@@ -28,6 +64,30 @@ class PQueue;
  *  make a priority queue (e.g. heap) that contains pointers to
  *  Events (instances of the derived classes).
  *
+ * Concurrent batches:
+ *  Events may declare a Footprint (the region their handler touches); an
+ *  object's events get theirs when they fire (see EventBatch.h).
+ *  run_event_batch drains every event at the time of the earliest one and
+ *  runs handlers whose footprints do not conflict in parallel.  While a
+ *  batch is running, newly created Events are staged (not inserted) and
+ *  are inserted into the queue in a deterministic order once the round
+ *  completes.  Handlers running in a batch must cancel() pending events
+ *  rather than delete them.
+ *
+ * Profiling:
+ *  Every event carries an EventTag naming its handler (border_cross, age,
+ *  a species' hunt, ...).  When compiled with EVENT_PROFILING, applying an
+ *  event records per-tag call counts and latencies (see EventProfile.h).
+ *
+ * Identity (for checkpoints):
+ *  An event that belongs to an object records that object (target) and,
+ *  if its handler captured a value (e.g., the energy being digested), that
+ *  value (arg).  Together with the tag this is enough to rebuild the
+ *  handler when a checkpoint is restored (see Checkpoint.h).  Every event
+ *  also gets a sequence number when it enters the queue; EventCompare
+ *  breaks ties between equal times with it, so the order of simultaneous
+ *  events is reproducible (and can be recorded, see Replay.h).
+ *
  * Implementation:
  *  We rely on a class "SimTime" to exist.  Most probably SimTime is a typedef
  *  to either int or double.
@@ -40,9 +100,12 @@ private:
     SimTime t;
     using Handler = std::function<void(void)>;
     Handler doit;
-    static PQueue equeue;         // a priority queue of all events
-    static SimTime _now;
     bool in_queue;
+    Footprint where;              // what the handler may touch (for batches)
+    EventTag tag;                 // which handler this is (for profiling)
+    const LifeForm* target;       // the object this event belongs to (if any)
+    double arg;                   // the value captured by the handler (if any)
+    uint64_t seq;                 // order in which the event entered the queue
 
     /* Implementation NOTE:
        If you inline these, you need to include the definition of PQueue
@@ -51,26 +114,151 @@ private:
        so, I choose not to inline them */
     void insert(void);            // insert this event into the priority queue
     void remove(void);            // remove this event from the priority queue
+    static void insert_all(const std::vector<Event*>&); // insert many events
+                                  // at once (loading a world snapshot): the
+                                  // heap is rebuilt once, in linear time,
+                                  // instead of sifting up each event
+    static Event* pop_next(SimTime limit); // remove and return the earliest
+                                  // event if it occurs no later than limit
+                                  // (otherwise return nullptr)
+
+    static void for_each_pending(std::function<void(Event*)>); // visit every
+                                  // event in the priority queue
+
+    /* the queue, clock and sequence counter of the calling thread's world
+       (Event.cpp reaches the queue through state().equeue) */
+    static EventQueueState*& bound_state(void) {
+        static thread_local EventQueueState* bound = nullptr;
+        return bound;
+    }
+    static EventQueueState& default_state(void) {
+        static EventQueueState process_queue;
+        return process_queue;
+    }
+    static EventQueueState& state(void) {
+        EventQueueState* s = bound_state();
+        return s ? *s : default_state();
+    }
+    static uint64_t& sequence_counter(void) { return state().next_seq; }
+    void enqueue(void) { seq = sequence_counter()++; insert(); }
+
+    /* while a batch round is running, each worker points this at its own
+       list and new Events are appended here instead of being inserted */
+    static std::vector<Event*>*& staged_events(void) {
+        static thread_local std::vector<Event*>* staged = nullptr;
+        return staged;
+    }
     bool active;
 
 public:
     /* interface */
-    void operator()(void) { if (active) { doit(); } }
+    void operator()(void) {
+        if (!active) return;
+#if REPLAY_LOG
+        ReplayLog::event(seq);
+#endif /* REPLAY_LOG */
+#if EVENT_PROFILING
+        if (EventProfiler::wants_depth_sample(t))
+            EventProfiler::record_depth(t, num_events());
+        EventProfiler::Scope scope(tag, t);
+#endif /* EVENT_PROFILING */
+#if SPECIES_PROFILING
+        /* charged to the target's species, whatever the tag (a species'
+           hunt may well be tagged EVENT_HUNT); a WakeTimer charges each of
+           its actions itself */
+        SpeciesProfiler::Scope species_scope(CALLBACK_EVENT,
+            target != nullptr && tag != EVENT_WAKEUP ? species_of_target(target) : 0);
+#endif /* SPECIES_PROFILING */
+#if CALLBACK_BUDGET
+        LifeForm* self = const_cast<LifeForm*>(target);
+        CallbackWatchdog::Scope budget(&self, target != nullptr,
+            target != nullptr && EventProfiler::is_species_tag(tag)
+            ? species_of_target(target) : 0, t);
+#endif /* CALLBACK_BUDGET */
+        SeqScope running(seq);
+        doit();
+    }
+
+    static SimTime now(void) { return state().now; }
+
+    /* the sequence number of the event the calling thread is handling (0
+       outside events).  Counter-based draws are keyed by it (Philox.h) */
+    static uint64_t& running_seq(void) {
+        static thread_local uint64_t seq = 0;
+        return seq;
+    }
 
-    static SimTime now(void) { return _now; }
+    /* running_seq() is 'seq' for the life of the scope.  Work done for an
+       event on a pool thread (SpeciesBatch::encounters) captures the
+       event's seq and runs under one of these */
+    class SeqScope {
+        uint64_t saved;
+    public:
+        explicit SeqScope(uint64_t seq) : saved(running_seq()) { running_seq() = seq; }
+        ~SeqScope(void) { running_seq() = saved; }
+    private:
+        SeqScope(const SeqScope&) = delete;
+        void operator=(const SeqScope&) = delete;
+    };
     static unsigned num_events(void); // the total number of events in the world
+
+    /* housekeeping events that reschedule themselves (samplers) count
+       themselves here while pending, and stop rescheduling once nothing
+       else is pending, so that RUN_TILL_EVENTS_EXHAUSTED still ends */
+    static void add_background(int n) { state().background += n; }
+    static bool only_background(void) { return num_events() <= state().background; }
     static void do_next(void);    // process the next event
 
 
   /* constructors and destructors */
-    Event(SimTime delta_time, Handler f) : doit(f) {
+    Event(SimTime delta_time, Handler f,
+          const Footprint& fp = Footprint::everywhere(),
+          EventTag tag = EVENT_UNTAGGED)
+        : doit(f), where(fp), tag(tag), target(nullptr), arg(0.0), seq(0) {
         if (delta_time < min_delta_time) delta_time = min_delta_time;
-        t = _now + delta_time;
+#if CALLBACK_BUDGET
+        delta_time = CallbackWatchdog::adjust_delay(delta_time, tag);
+#endif /* CALLBACK_BUDGET */
+        t = state().now + delta_time;
         active = true;
-        insert();
+        in_queue = false;
+        if (staged_events()) { staged_events()->push_back(this); }
+        else { enqueue(); }
     }
+    Event(SimTime delta_time, Handler f, EventTag tag)
+        : Event(delta_time, f, Footprint::everywhere(), tag) {}
     ~Event(void);
 
+private:
+    /* an event at exactly 'when' (now + (when - now) may round): a
+       WakeTimer's wakeup, armed at its earliest deadline */
+    struct At {};
+    Event(At, SimTime when, Handler f, EventTag tag)
+        : t(when), doit(f), where(Footprint::everywhere()), tag(tag), target(nullptr),
+          arg(0.0), seq(0), active(true) {
+        in_queue = false;
+        if (staged_events()) { staged_events()->push_back(this); }
+        else { enqueue(); }
+    }
+
+    /* move a queued event to 'when' (it takes a new sequence number, as a
+       new event would) */
+    void move_to(SimTime when) {
+        if (in_queue) { remove(); t = when; enqueue(); }
+        else { t = when; }      // staged: inserted later, at 'when'
+    }
+
+public:
+
+    /* record the object this event belongs to, e.g.
+         hunt_event = (new Event(dt, [this]() { hunt(); }, hunt_tag))
+                          ->set_target(this); */
+    Event* set_target(const LifeForm* who, double value = 0.0) {
+        target = who;
+        arg = value;
+        return this;
+    }
+
     void cancel(void) { if (this) active = false; }
     bool is_active(void) const { return this && active; }
 
@@ -81,6 +269,26 @@ private:
 
     /* The EventCompare class is used in Event.cc to implement the Event Queue */
     friend struct EventCompare;
+    friend unsigned run_event_batch(WorkPool&);
+    friend Footprint event_footprint(const Event*);
+    friend class Checkpoint;
+    friend class WorldSnapshot;
+    friend class World;
+    friend class WakeTimer;
 };
 
+#if SPECIES_PROFILING
+inline void SpeciesProfiler::sample_every(SimTime period, std::ostream& out) {
+  static EventTag sample_tag = EventProfiler::engine_tag("SpeciesProfiler::sample");
+  if (Event::only_background()) return;         // nothing left to profile
+  Event::add_background(1);
+  new Event(period, [period, &out]() {
+    Event::add_background(-1);
+    out << "species profile at t=" << double(Event::now()) << "\n";
+    report(out);
+    sample_every(period, out);
+  }, sample_tag);
+}
+#endif /* SPECIES_PROFILING */
+
 #endif /* !(_Event_h) */
@@ -0,0 +1,348 @@
+#if !(_EventBatch_h)
+#define _EventBatch_h 1
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Event.h"
+#include "World.h"
+
+/*
+ * Parallel execution of events that occur at the same time.
+ *
+ * Handlers that run on fixed grids (age, photosynthesize) produce many
+ * events with identical SimTime values.  run_event_batch removes every
+ * event at the time of the earliest event (so Event::now() is right for
+ * all of them), builds a conflict graph from the events' footprints and
+ * executes the batch as a sequence of rounds.  Events in the same round
+ * have pairwise disjoint footprints and run concurrently on a WorkPool.
+ * Conflicting events always land in different rounds, and an event is
+ * always placed in a later round than every earlier (in queue order)
+ * event it conflicts with, so conflicting handlers still run in the same
+ * order as they would under Event::do_next.
+ *
+ * Cancelled events are deleted as the batch is assembled.  The footprint
+ * of an event that belongs to an object (set_target) is computed then too,
+ * not when the event was made: the object may have moved since.  It is a
+ * circle about where the object is now that covers what its handlers
+ * touch (see event_footprint).  Other events keep the footprint they were
+ * made with ("everywhere" unless they declared one), so they run by
+ * themselves.
+ *
+ * Usage (the simulation loop, with PARALLEL_EVENTS defined):
+ *   WorkPool pool;
+ *   while (Event::num_events() > 0) { run_event_batch(pool); }
+ */
+
+/* the conflict graph is built on a grid with cells of this size. footprints
+   that cover more than batch_max_cells cells are treated as "everywhere"
+   (an object's footprint, about max_perceive_range, covers about 49) */
+const double batch_cell_size = 32.0;
+const unsigned batch_max_cells = 64;
+
+/*
+ * Handlers running in a batch may only touch objects inside their
+ * footprint.  The structures every handler shares are locked with
+ * batch_lock() while a round runs in parallel: the QuadTree takes it in
+ * each operation (QuadTree::share), and LifeForm.cpp takes it where the
+ * constructor and destructor change all_life.  A QuadTree change may
+ * resize the region of an object outside the footprint: its resize
+ * callback is deferred (QuadTree::deferred) and invoked after the round,
+ * in batch order, unless the object died meanwhile.
+ */
+inline std::recursive_mutex& batch_lock(void) {
+  static std::recursive_mutex lock;
+  return lock;
+}
+
+/*
+ * what the handlers of an object's event may touch: what the object can
+ * perceive, meet or place offspring in, about where it is now (its stored
+ * position is as of its update_time).  Only for active events: the
+ * target of a cancelled one may have been deleted
+ */
+inline Footprint event_footprint(const Event* e) {
+  if (e->target == nullptr) return e->where;
+  const LifeForm* lf = e->target;
+  double drift = lf->hot_speed() * double(Event::now() - lf->hot_update_time());
+  double reach = std::max(EngineParams::max_perceive_range(), EngineParams::reproduce_dist());
+  return Footprint(lf->position(), reach + EngineParams::encounter_distance() + drift);
+}
+
+/*
+ * Class name: WorkPool
+ * Description:
+ *  A small work-stealing thread pool.  Each thread (including the thread
+ *  that calls run) owns a deque of tasks.  A thread takes tasks from the
+ *  back of its own deque and, when that is empty, steals from the front
+ *  of the other threads' deques.  run() returns once every task is done.
+ */
+class WorkPool {
+public:
+  using Task = std::function<void(void)>;
+
+private:
+  struct TaskQueue {
+    std::mutex lock;
+    std::deque<Task*> tasks;
+  };
+
+  std::vector<std::unique_ptr<TaskQueue>> queues; // queues[0] is the caller's
+  std::vector<std::thread> threads;
+
+  std::mutex lock;
+  std::condition_variable wake;    // signalled when a new run starts
+  std::condition_variable done;    // signalled when the last task finishes
+  std::atomic<unsigned> remaining;
+  std::atomic<bool> running;       // a run() is in progress
+  unsigned generation;
+  bool stopping;
+
+  /* COPYING is NOT PERMITTED */
+  WorkPool(const WorkPool&) = delete;
+  WorkPool& operator=(const WorkPool&) = delete;
+
+  bool take(unsigned self, Task*& task) {
+    {
+      TaskQueue& mine = *queues[self];
+      std::lock_guard<std::mutex> guard(mine.lock);
+      if (!mine.tasks.empty()) {
+        task = mine.tasks.back();
+        mine.tasks.pop_back();
+        return true;
+      }
+    }
+    for (unsigned k = 1; k < queues.size(); k += 1) {
+      TaskQueue& victim = *queues[(self + k) % queues.size()];
+      std::lock_guard<std::mutex> guard(victim.lock);
+      if (!victim.tasks.empty()) {
+        task = victim.tasks.front();
+        victim.tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void finish_one(void) {
+    if (remaining.fetch_sub(1) == 1) {
+      std::lock_guard<std::mutex> guard(lock);
+      done.notify_all();
+    }
+  }
+
+  void drain(unsigned self) {
+    Task* task;
+    while (remaining.load() > 0) {
+      if (take(self, task)) {
+        (*task)();
+        finish_one();
+      }
+      else {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  void worker(unsigned self) {
+    unsigned seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        wake.wait(guard, [&]() { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+      }
+      drain(self);
+    }
+  }
+
+public:
+  explicit WorkPool(unsigned num_threads = std::thread::hardware_concurrency())
+    : remaining(0), running(false), generation(0), stopping(false) {
+    if (num_threads == 0) num_threads = 1;
+    for (unsigned k = 0; k < num_threads; k += 1)
+      queues.emplace_back(new TaskQueue);
+    for (unsigned k = 1; k < num_threads; k += 1)
+      threads.emplace_back([this, k]() { worker(k); });
+  }
+
+  ~WorkPool(void) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : threads) t.join();
+  }
+
+  unsigned size(void) const { return queues.size(); }
+
+  /* run every task and return when all are done.  A run() made while
+     another is in progress (from one of its tasks, or from another
+     thread) runs its tasks on the calling thread instead.
+     (remaining is set before any task is published: a worker still
+     draining the previous round may take a new task as soon as it is
+     queued, and must find it counted) */
+  void run(std::vector<Task>& tasks) {
+    if (tasks.empty()) return;
+    if (running.exchange(true)) {
+      for (Task& task : tasks) task();
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      remaining.store(tasks.size());
+      generation += 1;
+    }
+    for (size_t k = 0; k < tasks.size(); k += 1) {
+      TaskQueue& q = *queues[k % queues.size()];
+      std::lock_guard<std::mutex> guard(q.lock);
+      q.tasks.push_back(&tasks[k]);
+    }
+    wake.notify_all();
+
+    drain(0);
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      done.wait(guard, [&]() { return remaining.load() == 0; });
+    }
+    running.store(false);
+  }
+};
+
+/*
+ * assign each event of the batch to a round.  An event's round is one more
+ * than the latest round of any earlier event that shares a grid cell with
+ * it (sharing a cell is a conservative test for conflicting footprints).
+ * Returns the number of rounds.
+ */
+inline unsigned assign_batch_rounds(const std::vector<Footprint>& where,
+                                    std::vector<unsigned>& round) {
+  std::unordered_map<uint64_t, unsigned> cell_round;
+  unsigned floor_round = 0;     // every event after an "everywhere" event
+                                // must run after it
+  unsigned last_round = 0;
+
+  round.resize(where.size());
+  for (size_t k = 0; k < where.size(); k += 1) {
+    const Footprint& f = where[k];
+    bool everywhere = f.is_everywhere();
+    int32_t x0 = 0, x1 = 0, y0 = 0, y1 = 0;
+    if (!everywhere) {
+      x0 = (int32_t) floor((f.center.xpos - f.radius) / batch_cell_size);
+      x1 = (int32_t) floor((f.center.xpos + f.radius) / batch_cell_size);
+      y0 = (int32_t) floor((f.center.ypos - f.radius) / batch_cell_size);
+      y1 = (int32_t) floor((f.center.ypos + f.radius) / batch_cell_size);
+      double cells = double(x1 - x0 + 1) * double(y1 - y0 + 1);
+      everywhere = cells > batch_max_cells;
+    }
+
+    if (everywhere) {
+      round[k] = last_round + 1;
+      floor_round = round[k];
+      last_round = round[k];
+      continue;
+    }
+
+    unsigned r = floor_round + 1;
+    for (int32_t x = x0; x <= x1; x += 1) {
+      for (int32_t y = y0; y <= y1; y += 1) {
+        uint64_t key = (uint64_t(uint32_t(x)) << 32) | uint32_t(y);
+        auto p = cell_round.find(key);
+        if (p != cell_round.end() && p->second + 1 > r) r = p->second + 1;
+      }
+    }
+    for (int32_t x = x0; x <= x1; x += 1) {
+      for (int32_t y = y0; y <= y1; y += 1) {
+        uint64_t key = (uint64_t(uint32_t(x)) << 32) | uint32_t(y);
+        cell_round[key] = r;
+      }
+    }
+    round[k] = r;
+    if (r > last_round) last_round = r;
+  }
+  return last_round;
+}
+
+/*
+ * process every event at the time of the next event.  Returns the number
+ * of events removed from the queue (zero if the queue is empty).
+ */
+inline unsigned run_event_batch(WorkPool& pool) {
+  Event* first = Event::pop_next(SimTime::max());
+  if (first == nullptr) return 0;
+
+  /* a cancelled event does nothing when it runs, and its target may
+     already be gone: delete it here rather than look at its footprint */
+  Event::state().now = first->t;
+  SimTime at = first->t;
+  unsigned removed = 0;
+  std::vector<Event*> batch;
+  for (Event* e = first; e != nullptr; e = Event::pop_next(at)) {
+    removed += 1;
+    if (e->is_active()) batch.push_back(e);
+    else delete e;
+  }
+
+  std::vector<Footprint> where;
+  where.reserve(batch.size());
+  for (Event* e : batch) where.push_back(event_footprint(e));
+  std::vector<unsigned> round;
+  unsigned num_rounds = assign_batch_rounds(where, round);
+
+  typedef QuadTree<SmartPointer<LifeForm>> Space;
+  World* world = World::current();   // the workers run in the caller's world
+  std::vector<std::vector<Event*>> staged(batch.size());
+  std::vector<std::vector<Space::Resized>> resized(batch.size());
+  std::vector<WorkPool::Task> tasks;
+  std::vector<size_t> members;
+  for (unsigned r = 1; r <= num_rounds; r += 1) {
+    tasks.clear();
+    members.clear();
+    for (size_t k = 0; k < batch.size(); k += 1) {
+      if (round[k] != r) continue;
+      members.push_back(k);
+      tasks.push_back([&batch, &staged, &resized, k, world]() {
+        World::Bind bind(world);
+        Event::staged_events() = &staged[k];
+        Space::deferred() = &resized[k];
+        (*batch[k])();
+        delete batch[k];
+        Space::deferred() = nullptr;
+        Event::staged_events() = nullptr;
+      });
+    }
+    if (tasks.size() == 1) { tasks[0](); }
+    else {
+      LifeForm::space().share(&batch_lock());
+      pool.run(tasks);
+      LifeForm::space().share(nullptr);
+    }
+
+    /* invoke the deferred resize callbacks and insert the new events in
+       batch order, so the queue (and therefore tie-breaking between equal
+       times) does not depend on thread timing */
+    for (size_t k : members) {
+      Event::staged_events() = &staged[k];
+      for (Space::Resized& r : resized[k])
+        if (r.obj->is_alive) r.callback();
+      Event::staged_events() = nullptr;
+      resized[k].clear();
+      for (Event* e : staged[k]) e->enqueue();
+      staged[k].clear();
+    }
+  }
+  return removed;
+}
+
+#endif /* !(_EventBatch_h) */
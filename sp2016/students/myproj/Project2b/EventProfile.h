@@ -0,0 +1,374 @@
+#if !(_EventProfile_h)
+#define _EventProfile_h 1
+
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "SimTime.h"
+
+/*
+ * Per-handler event profiling.
+ *
+ * Every Event carries an EventTag (given when the Event is constructed).
+ * When the simulator is compiled with EVENT_PROFILING, Event::operator()
+ * records, for each tag, the number of handler calls, the total time spent
+ * in the handler and a histogram of handler latencies.  The length of the
+ * event queue is sampled once per simulated time unit.
+ *
+ * Optionally (enable_trace), the most recent handler calls are kept in a
+ * ring buffer.  dump_chrome_trace writes that buffer (and the queue depth
+ * samples) in the Chrome trace_event JSON format, which can be loaded into
+ * chrome://tracing or any other trace viewer.
+ *
+ * The engine tags are listed below.  Species can register their own tags
+ * by name, e.g.
+ *   static EventTag hunt_tag = EventProfiler::tag("Craig::hunt");
+ * and the engine's own named events use engine_tag() instead, so that
+ * they are not taken for species code (is_species_tag).
+ *
+ * Counters are kept per thread (so events running in a parallel batch do
+ * not contend) and are merged when a report is printed.
+ */
+typedef uint16_t EventTag;
+
+enum EngineEventTag {
+  EVENT_UNTAGGED = 0,
+  EVENT_BORDER_CROSS,
+  EVENT_AGE,
+  EVENT_PHOTOSYNTHESIZE,
+  EVENT_HUNT,
+  EVENT_DIGEST,
+  EVENT_REPRODUCE,
+  EVENT_ENCOUNTER,
+  EVENT_WAKEUP,                 // a WakeTimer's single queue entry
+  NUM_ENGINE_EVENT_TAGS
+};
+
+class EventProfiler {
+public:
+  static const unsigned num_buckets = 32; // bucket k holds latencies in
+                                          // [2^(k-1), 2^k) nanoseconds
+
+  struct TagStats {
+    uint64_t calls = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    uint64_t histogram[num_buckets] = {};
+  };
+
+  struct TraceRecord {
+    EventTag tag;
+    SimTime when;               // simulated time of the event
+    uint64_t start_ns;          // wall time since the profiler started
+    uint64_t duration_ns;
+  };
+
+  struct DepthSample {
+    SimTime when;
+    uint64_t wall_ns;
+    unsigned depth;
+  };
+
+private:
+  /* one Table per thread that has run an event */
+  struct Table {
+    unsigned thread_id;
+    std::vector<TagStats> stats;
+    std::vector<TraceRecord> trace;  // ring buffer (empty unless tracing)
+    size_t trace_next = 0;
+    uint64_t trace_total = 0;
+  };
+
+  struct Globals {
+    std::mutex lock;
+    std::vector<std::string> names;
+    std::vector<std::unique_ptr<Table>> tables;
+    std::vector<DepthSample> depth;
+    std::atomic<double> next_depth_sample{0.0};
+    size_t trace_capacity = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    Globals(void) {
+      const char* engine[NUM_ENGINE_EVENT_TAGS] = {
+        "untagged", "border_cross", "age", "photosynthesize",
+        "hunt", "digest", "reproduce", "encounter", "wakeup"
+      };
+      names.assign(engine, engine + NUM_ENGINE_EVENT_TAGS);
+    }
+  };
+
+  static Globals& globals(void) {
+    static Globals g;
+    return g;
+  }
+
+  /* the registered tags that are engine_tag()s, one bit per tag */
+  static std::atomic<uint64_t>* engine_bits(void) {
+    static std::atomic<uint64_t> bits[65536 / 64];
+    return bits;
+  }
+
+  static Table& local(void) {
+    static thread_local Table* table = nullptr;
+    if (table == nullptr) {
+      Globals& g = globals();
+      std::lock_guard<std::mutex> guard(g.lock);
+      g.tables.emplace_back(new Table);
+      table = g.tables.back().get();
+      table->thread_id = g.tables.size() - 1;
+      table->trace.resize(g.trace_capacity);
+    }
+    return *table;
+  }
+
+  static unsigned bucket(uint64_t ns) {
+    unsigned k = 0;
+    while (ns != 0 && k < num_buckets - 1) { ns >>= 1; k += 1; }
+    return k;
+  }
+
+public:
+  static uint64_t clock_ns(void) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - globals().start).count();
+  }
+
+  /* whether an event (or WakeTimer action) with this tag runs species code:
+     untagged, EVENT_HUNT (a species' hunt, and Behavior's sleep), or a tag
+     registered with tag() rather than engine_tag() */
+  static bool is_species_tag(EventTag tag) {
+    if (tag == EVENT_UNTAGGED || tag == EVENT_HUNT) return true;
+    if (tag < NUM_ENGINE_EVENT_TAGS) return false;
+    return !(engine_bits()[tag / 64].load(std::memory_order_relaxed) & (uint64_t(1) << tag % 64));
+  }
+
+  /* return the tag with this name (registering it if necessary) */
+  static EventTag tag(const std::string& name) {
+    Globals& g = globals();
+    std::lock_guard<std::mutex> guard(g.lock);
+    for (size_t k = 0; k < g.names.size(); k += 1)
+      if (g.names[k] == name) return EventTag(k);
+    g.names.push_back(name);
+    return EventTag(g.names.size() - 1);
+  }
+
+  /* tag() for the engine's own housekeeping events (samplers, sweeps,
+     batch flushes), which are not species code */
+  static EventTag engine_tag(const std::string& name) {
+    EventTag t = tag(name);
+    engine_bits()[t / 64].fetch_or(uint64_t(1) << t % 64, std::memory_order_relaxed);
+    return t;
+  }
+
+  static std::string tag_name(EventTag t) {
+    Globals& g = globals();
+    std::lock_guard<std::mutex> guard(g.lock);
+    return t < g.names.size() ? g.names[t] : std::string("tag#") + std::to_string(t);
+  }
+
+  /* keep the last 'capacity' handler calls (per thread) for dump_chrome_trace.
+     Call this before the simulation starts */
+  static void enable_trace(size_t capacity) {
+    Globals& g = globals();
+    std::lock_guard<std::mutex> guard(g.lock);
+    g.trace_capacity = capacity;
+    for (auto& t : g.tables) {
+      t->trace.assign(capacity, TraceRecord());
+      t->trace_next = 0;
+      t->trace_total = 0;
+    }
+  }
+
+  static void record(EventTag tag, SimTime when, uint64_t start_ns, uint64_t duration_ns) {
+    Table& table = local();
+    if (tag >= table.stats.size()) table.stats.resize(tag + 1);
+    TagStats& s = table.stats[tag];
+    s.calls += 1;
+    s.total_ns += duration_ns;
+    if (duration_ns > s.max_ns) s.max_ns = duration_ns;
+    s.histogram[bucket(duration_ns)] += 1;
+
+    if (!table.trace.empty()) {
+      TraceRecord& r = table.trace[table.trace_next];
+      r.tag = tag;
+      r.when = when;
+      r.start_ns = start_ns;
+      r.duration_ns = duration_ns;
+      table.trace_next = (table.trace_next + 1) % table.trace.size();
+      table.trace_total += 1;
+    }
+  }
+
+  /* queue depth is sampled once per simulated time unit */
+  static bool wants_depth_sample(SimTime when) {
+    return double(when) >= globals().next_depth_sample.load(std::memory_order_relaxed);
+  }
+
+  static void record_depth(SimTime when, unsigned depth) {
+    Globals& g = globals();
+    std::lock_guard<std::mutex> guard(g.lock);
+    if (double(when) < g.next_depth_sample.load()) return;
+    DepthSample d = { when, clock_ns(), depth };
+    g.depth.push_back(d);
+    g.next_depth_sample.store(floor(double(when)) + 1.0);
+  }
+
+  /*
+   * Scope measures one handler call.  Event::operator() creates one
+   * around the handler when EVENT_PROFILING is defined.
+   */
+  class Scope {
+    EventTag tag;
+    SimTime when;
+    uint64_t start;
+  public:
+    Scope(EventTag tag, SimTime when) : tag(tag), when(when), start(clock_ns()) {}
+    ~Scope(void) { record(tag, when, start, clock_ns() - start); }
+  };
+
+  /* the statistics for every tag, summed over all threads */
+  static std::vector<TagStats> totals(void) {
+    Globals& g = globals();
+    std::lock_guard<std::mutex> guard(g.lock);
+    std::vector<TagStats> sum(g.names.size());
+    for (auto& t : g.tables) {
+      for (size_t k = 0; k < t->stats.size(); k += 1) {
+        const TagStats& s = t->stats[k];
+        if (k >= sum.size()) sum.resize(k + 1);
+        sum[k].calls += s.calls;
+        sum[k].total_ns += s.total_ns;
+        if (s.max_ns > sum[k].max_ns) sum[k].max_ns = s.max_ns;
+        for (unsigned b = 0; b < num_buckets; b += 1)
+          sum[k].histogram[b] += s.histogram[b];
+      }
+    }
+    return sum;
+  }
+
+  /* upper bound (in ns) of the bucket holding the given fraction of calls */
+  static uint64_t percentile(const TagStats& s, double fraction) {
+    uint64_t want = uint64_t(fraction * s.calls);
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < num_buckets; b += 1) {
+      seen += s.histogram[b];
+      if (seen > want) return std::min(uint64_t(1) << b, s.max_ns);
+    }
+    return s.max_ns;
+  }
+
+  static void report(std::ostream& out) {
+    std::vector<TagStats> sum = totals();
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::left << std::setw(24) << "handler"
+        << std::right << std::setw(12) << "calls"
+        << std::setw(12) << "total ms"
+        << std::setw(10) << "mean us"
+        << std::setw(10) << "p50 us"
+        << std::setw(10) << "p99 us"
+        << std::setw(10) << "max us" << "\n";
+    for (size_t k = 0; k < sum.size(); k += 1) {
+      const TagStats& s = sum[k];
+      if (s.calls == 0) continue;
+      out << std::left << std::setw(24) << tag_name(EventTag(k))
+          << std::right << std::setw(12) << s.calls
+          << std::setw(12) << std::fixed << std::setprecision(2) << s.total_ns / 1.0e6
+          << std::setw(10) << s.total_ns / 1.0e3 / s.calls
+          << std::setw(10) << percentile(s, 0.50) / 1.0e3
+          << std::setw(10) << percentile(s, 0.99) / 1.0e3
+          << std::setw(10) << s.max_ns / 1.0e3 << "\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+    Globals& g = globals();
+    std::lock_guard<std::mutex> guard(g.lock);
+    if (!g.depth.empty()) {
+      out << "queue depth (per simulated time unit):";
+      for (const DepthSample& d : g.depth) out << " " << d.depth;
+      out << "\n";
+    }
+  }
+
+  /* 's' as the contents of a JSON string (tag names are registered by
+     species code and may hold anything) */
+  static std::string json_escape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size());
+    for (unsigned char c : s) {
+      switch (c) {
+      case '"':  out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (c < 0x20) {
+          char code[8];
+          snprintf(code, sizeof(code), "\\u%04x", c);
+          out += code;
+        } else {
+          out += char(c);
+        }
+      }
+    }
+    return out;
+  }
+
+  /*
+   * write the trace ring buffers and the queue depth samples as Chrome
+   * trace_event JSON.  Timestamps are wall clock microseconds (written
+   * to the nanosecond, so that events stay apart however long the run);
+   * each handler call also records the simulated time at which it
+   * occurred.
+   */
+  static void dump_chrome_trace(std::ostream& out) {
+    Globals& g = globals();
+    std::lock_guard<std::mutex> guard(g.lock);
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (auto& t : g.tables) {
+      size_t cap = t->trace.size();
+      size_t count = t->trace_total < cap ? size_t(t->trace_total) : cap;
+      size_t begin = (t->trace_next + cap - count) % (cap ? cap : 1);
+      for (size_t k = 0; k < count; k += 1) {
+        const TraceRecord& r = t->trace[(begin + k) % cap];
+        std::string name = r.tag < g.names.size() ? g.names[r.tag] : "tag#" + std::to_string(r.tag);
+        out << (first ? "" : ",\n")
+            << "{\"name\":\"" << json_escape(name) << "\",\"cat\":\"event\",\"ph\":\"X\""
+            << std::fixed << std::setprecision(3)
+            << ",\"ts\":" << r.start_ns / 1.0e3
+            << ",\"dur\":" << r.duration_ns / 1.0e3
+            << ",\"pid\":0,\"tid\":" << t->thread_id;
+        out.flags(flags);
+        out.precision(precision);
+        out << ",\"args\":{\"sim_time\":" << double(r.when) << "}}";
+        first = false;
+      }
+    }
+    for (const DepthSample& d : g.depth) {
+      out << (first ? "" : ",\n")
+          << "{\"name\":\"queue depth\",\"ph\":\"C\",\"ts\":"
+          << std::fixed << std::setprecision(3) << d.wall_ns / 1.0e3;
+      out.flags(flags);
+      out.precision(precision);
+      out << ",\"pid\":0,\"args\":{\"events\":" << d.depth
+          << ",\"sim_time\":" << double(d.when) << "}}";
+      first = false;
+    }
+    out << "\n]}\n";
+  }
+};
+
+#endif /* !(_EventProfile_h) */
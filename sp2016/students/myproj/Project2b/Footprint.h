@@ -0,0 +1,40 @@
+#if !(_Footprint_h)
+#define _Footprint_h 1
+
+#include <cassert>
+#include "Point.h"
+
+/*
+ * Class name: Footprint
+ * Description:
+ *  The part of the world that an event handler may read or write when it
+ *  runs.  A footprint is a circle (center, radius).  Handlers that do not
+ *  declare a footprint get the "everywhere" footprint, which conflicts with
+ *  every other footprint (so undeclared handlers always run by themselves).
+ *
+ *  Two events may run concurrently only if their footprints do not
+ *  conflict.  A LifeForm handler that perceives, moves or encounters
+ *  should declare a circle about its position that is large enough to
+ *  cover all of that (e.g., position + max_perceive_range).
+ */
+struct Footprint {
+  Point center;
+  double radius;                // a negative radius means "everywhere"
+
+  Footprint(void) : center(), radius(-1.0) {}
+  Footprint(const Point& c, double r) : center(c), radius(r) {}
+
+  static Footprint everywhere(void) { return Footprint(); }
+
+  bool is_everywhere(void) const { return radius < 0.0; }
+
+  bool conflicts(const Footprint& f) const {
+    if (is_everywhere() || f.is_everywhere()) return true;
+    double reach = radius + f.radius;
+    double dx = center.xpos - f.center.xpos;
+    double dy = center.ypos - f.center.ypos;
+    return dx * dx + dy * dy <= reach * reach;
+  }
+};
+
+#endif /* !(_Footprint_h) */
@@ -0,0 +1,212 @@
+/*
+ * Headless.cpp
+ *
+ * Batch-mode runner for the Project2b engine: the standard throughput
+ * benchmark.  It populates the world with a mix of every registered
+ * species (round robin, at uniformly random free positions, from a fixed
+ * seed), runs the event loop up to a simulated time limit without
+ * drawing anything, and reports
+ *
+ *   population  setup(s)  events  events/s  wall(s)  peak RSS(KB)
+ *     final population  tree depth
+ *
+ * one line per scenario.  setup is the time taken to build the initial
+ * world: populating it, or loading it from a snapshot (-r, which also
+ * prints the load's size, rate and phases to stderr).  -w saves the
+ * populated world as a snapshot, so that later runs can start from it
+ * (see WorldSnapshot.h).  Without -n, the three standard scenarios (10k,
+ * 100k and 1M objects) each run in a child process, so that every one
+ * starts from an empty world and reports its own peak RSS.
+ *
+ * Build (with the rest of the engine, minus the FLTK main):
+ *   g++ -std=c++14 -O2 -DNO_WINDOW=1 Headless.cpp <engine and species .cpp files>
+ *
+ * Usage:
+ *   Headless [-n population] [-t time_limit] [-s seed] [-r snapshot | -w snapshot]
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#ifdef _MSC_VER
+# include <windows.h>
+# include <psapi.h>
+#else
+# include <sys/resource.h>
+# include <sys/wait.h>
+# include <unistd.h>
+#endif
+
+#include "LifeForm.h"
+#include "QuadTree.h"
+#include "Event.h"
+#include "Params.h"
+#include "Random.h"
+#include "WorldSnapshot.h"
+#if SPECIES_PROFILING
+#include "SpeciesProfile.h"
+#endif /* SPECIES_PROFILING */
+
+#if defined (_MSC_VER)
+using epl::drand48;
+#endif
+
+class Headless {
+public:
+  struct Report {
+    unsigned population;
+    double setup;               // seconds
+    uint64_t events;
+    double wall;                // seconds
+    long peak_rss;              // KB
+    size_t survivors;
+    unsigned depth;
+  };
+
+  /* put 'population' objects of the registered species into the world */
+  static void populate(unsigned population) {
+    std::vector<IstreamCreator> creators;
+    for (auto& entry : LifeForm::istream_creators()) creators.push_back(entry.second);
+    if (creators.empty()) {
+      fprintf(stderr, "Headless: no species are registered\n");
+      exit(1);
+    }
+    for (unsigned k = 0; k < population; k += 1) {
+      Point p;
+      do {
+        p = Point(drand48() * grid_max, drand48() * grid_max);
+      } while (LifeForm::space().is_occupied(p));
+      LifeForm::place(creators[k % creators.size()](), p);
+    }
+  }
+
+  static size_t survivors(void) {
+    size_t count = 0;
+    for (LifeForm* lf : LifeForm::all_life()) count += lf->is_alive;
+    return count;
+  }
+
+  static long peak_rss(void) {
+#ifdef _MSC_VER
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return long(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;     // KB on Linux
+#endif
+  }
+
+  /* 'read' or 'write' name a snapshot to start from, or to save after
+     populating (empty: neither) */
+  static Report run(unsigned population, double time_limit, long seed,
+                    const std::string& read = "", const std::string& write = "") {
+#if defined (_MSC_VER)
+    epl::random_generator.seed(seed);
+#else
+    srand48(seed);
+#endif
+    Report r;
+#if SPECIES_PROFILING
+    SpeciesProfiler::reset();   // report this run only
+#endif /* SPECIES_PROFILING */
+    auto setup = std::chrono::steady_clock::now();
+    if (read.empty()) populate(population);
+    else if (!WorldSnapshot::load(read)) {
+      fprintf(stderr, "Headless: cannot load %s\n", read.c_str());
+      exit(1);
+    }
+    else {
+      const WorldSnapshot::LoadTimes& t = WorldSnapshot::last_load();
+      fprintf(stderr, "Headless: loaded %.1f MB in %.3fs (read %.3fs, create %.3fs, "
+              "index %.3fs, events %.3fs; %.0f MB/s)\n",
+              t.bytes / 1.0e6, t.total, t.read, t.create, t.index, t.events,
+              t.bytes / 1.0e6 / (t.total > 0.0 ? t.total : 1.0));
+    }
+    auto start = std::chrono::steady_clock::now();
+    r.setup = std::chrono::duration<double>(start - setup).count();
+    if (!write.empty() && !WorldSnapshot::save(write))
+      fprintf(stderr, "Headless: cannot save %s\n", write.c_str());
+
+    r.population = read.empty() ? population : unsigned(survivors());
+    r.events = 0;
+    start = std::chrono::steady_clock::now();
+    while (Event::num_events() > 0 && Event::now() < time_limit) {
+      Event::do_next();
+      r.events += 1;
+    }
+    auto stop = std::chrono::steady_clock::now();
+    r.wall = std::chrono::duration<double>(stop - start).count();
+    r.peak_rss = peak_rss();
+    r.survivors = survivors();
+    r.depth = LifeForm::space().depth();
+#if SPECIES_PROFILING
+    SpeciesProfiler::report(std::cerr);
+#endif /* SPECIES_PROFILING */
+    return r;
+  }
+
+  static void print_header(void) {
+    printf("%10s %9s %12s %12s %9s %12s %10s %6s\n",
+           "population", "setup(s)", "events", "events/s", "wall(s)", "peakRSS(KB)",
+           "final", "depth");
+  }
+
+  static void print(const Report& r) {
+    printf("%10u %9.3f %12llu %12.0f %9.3f %12ld %10zu %6u\n",
+           r.population, r.setup, (unsigned long long) r.events,
+           r.wall > 0.0 ? r.events / r.wall : 0.0, r.wall, r.peak_rss,
+           r.survivors, r.depth);
+    fflush(stdout);
+  }
+};
+
+int main(int argc, char* argv[]) {
+  unsigned population = 0;      // 0: run the standard scenarios
+  double time_limit = 100.0;
+  long seed = 42;
+  std::string read, write;      // snapshot to start from, or to save
+
+  for (int k = 1; k < argc; k += 1) {
+    std::string arg = argv[k];
+    if (arg == "-n" && k + 1 < argc) population = strtoul(argv[++k], nullptr, 10);
+    else if (arg == "-t" && k + 1 < argc) time_limit = strtod(argv[++k], nullptr);
+    else if (arg == "-s" && k + 1 < argc) seed = strtol(argv[++k], nullptr, 10);
+    else if (arg == "-r" && k + 1 < argc) read = argv[++k];
+    else if (arg == "-w" && k + 1 < argc) write = argv[++k];
+    else {
+      fprintf(stderr, "usage: %s [-n population] [-t time_limit] [-s seed]"
+              " [-r snapshot | -w snapshot]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  Headless::print_header();
+  if (population > 0 || !read.empty()) {
+    Headless::print(Headless::run(population, time_limit, seed, read, write));
+    return 0;
+  }
+
+  for (unsigned n : { 10000u, 100000u, 1000000u }) {
+#ifdef _MSC_VER
+    /* no fork: the scenarios share one world, so run only the first */
+    Headless::print(Headless::run(n, time_limit, seed));
+    break;
+#else
+    pid_t child = fork();
+    if (child == 0) {
+      Headless::print(Headless::run(n, time_limit, seed));
+      _exit(0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      fprintf(stderr, "Headless: the %u object scenario failed\n", n);
+#endif
+  }
+  return 0;
+}
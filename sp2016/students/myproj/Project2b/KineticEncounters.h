@@ -0,0 +1,254 @@
+#if !(_KineticEncounters_h)
+#define _KineticEncounters_h 1
+
+#if KINETIC_ENCOUNTERS
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "Event.h"
+#include "EventProfile.h"
+#include "LifeForm.h"
+#include "Params.h"
+#include "Point.h"
+#if PARALLEL_ENCOUNTERS
+#include "EncounterBatch.h"
+#endif /* PARALLEL_ENCOUNTERS */
+
+/*
+ * Kinetic encounter scheduling (KINETIC_ENCOUNTERS).
+ *
+ * Normally encounters are looked for only when an object crosses a
+ * QuadTree border or its region is resized.  Two objects that approach
+ * each other inside one leaf can miss.
+ *
+ * With KINETIC_ENCOUNTERS each pair is scheduled where the two objects
+ * actually meet.  Both objects move in straight lines until one of them
+ * changes course or speed, so plan() can compute, for each neighbour, the
+ * first time their centers are encounter_distance apart and schedule one
+ * event for that moment.  Every object carries a motion_version, which
+ * set_course, set_speed and die bump.  The event records both versions
+ * and does nothing if either has changed, so a turn needs no cancelling.
+ * The event holds plain pointers, not SmartPointers, so it keeps no object
+ * alive: die() and withdraw() call forget(), which cancels the object's
+ * pending approaches.
+ *
+ * plan(lf) runs when an object is placed, when its course or speed changes
+ * (after the version is bumped), and every kinetic_horizon time units
+ * while it moves.  It looks at every object that could come within
+ * encounter_distance before the next plan.  The scan radius allows for
+ * both objects moving at max_speed for kinetic_horizon, plus the distance a
+ * neighbour may have moved since its QuadTree position was last updated.
+ * Stationary objects plan only when placed.  The objects that move toward
+ * them find them.
+ *
+ * An approach is one encounter.  Two objects that keep closing after an
+ * encounter are met again at their closest point.  If either one turns,
+ * its version changes and the pair is planned afresh, so objects that turn
+ * back toward each other meet again.
+ *
+ * check_encounter no longer resolves anything in this mode.  Every mover
+ * still schedules its border crossings: they keep its QuadTree position
+ * up to date and send it out of bounds when it leaves the space.
+ *
+ * The pending approaches belong to the Habitat (made on first use), so
+ * each World has its own.
+ */
+
+/* a moving object plans again this often, so newcomers are noticed */
+const SimTime kinetic_horizon = 2.0;
+
+/*
+ * Class name: Approach
+ * Description:
+ *  when two straight-line movers first come within a distance
+ */
+struct Approach {
+  bool meets;                   // false: they never come that close
+  SimTime after;                // how long from now (0: already within it)
+  SimTime closest;              // when they are closest (from now)
+
+  /*
+   * a at pa moving (course_a, speed_a), b likewise.  Solves
+   * |d + v t| = radius for the first t >= 0, where d is b - a and v is b's
+   * velocity relative to a's.  Objects already within 'radius' meet now if
+   * they are still closing, and otherwise not at all.
+   */
+  static Approach between(const Point& pa, double course_a, double speed_a,
+                          const Point& pb, double course_b, double speed_b,
+                          double radius) {
+    Approach r;
+    r.meets = false;
+    r.after = 0.0;
+    r.closest = 0.0;
+    double dx = pb.xpos - pa.xpos;
+    double dy = pb.ypos - pa.ypos;
+    double vx = speed_b * cos(course_b) - speed_a * cos(course_a);
+    double vy = speed_b * sin(course_b) - speed_a * sin(course_a);
+    double dv = dx * vx + dy * vy;      // < 0: closing
+    double vv = vx * vx + vy * vy;
+    double dd = dx * dx + dy * dy;
+    double rr = radius * radius;
+    if (vv > 0.0 && dv < 0.0) r.closest = -dv / vv;
+    if (dd <= rr) {
+      r.meets = dv < 0.0;
+      return r;
+    }
+    if (vv == 0.0 || dv >= 0.0) return r;
+    /* vv t^2 + 2 dv t + (dd - rr) = 0, the smaller root */
+    double disc = dv * dv - vv * (dd - rr);
+    if (disc < 0.0) return r;
+    r.meets = true;
+    r.after = (-dv - sqrt(disc)) / vv;
+    return r;
+  }
+};
+
+class KineticEncounters {
+  /* a scheduled approach: the pair (lower address first) and the versions
+     it was computed for.  An identical approach is never scheduled twice */
+  typedef std::tuple<const LifeForm*, const LifeForm*, uint32_t, uint32_t> Key;
+
+  std::map<Key, Event*> scheduled;
+  std::unordered_map<const LifeForm*, std::vector<Key>> keys_of; // both sides
+
+  static KineticEncounters& pending(void) {
+    std::shared_ptr<KineticEncounters>& k = LifeForm::habitat().kinetic;
+    if (!k) k = std::make_shared<KineticEncounters>();
+    return *k;
+  }
+
+  static EventTag approach_tag(void) {
+    static EventTag tag = EventProfiler::engine_tag("kinetic_approach");
+    return tag;
+  }
+
+  static EventTag plan_tag(void) {
+    static EventTag tag = EventProfiler::engine_tag("kinetic_plan");
+    return tag;
+  }
+
+  static Key key_of(const LifeForm* a, const LifeForm* b) {
+    return b < a ? Key(b, a, b->motion_version, a->motion_version)
+                 : Key(a, b, a->motion_version, b->motion_version);
+  }
+
+  /* where lf is now (its stored position is as of its update_time) */
+  static Point where_now(const LifeForm* lf) {
+    Point p = lf->hot_position();
+    double d = lf->hot_speed() * (Event::now() - lf->hot_update_time());
+    return Point(p.xpos + d * cos(lf->hot_course()), p.ypos + d * sin(lf->hot_course()));
+  }
+
+  static double scan_radius(const LifeForm* lf) {
+    return EngineParams::encounter_distance() +
+      (lf->hot_speed() + 2.0 * EngineParams::max_speed()) * kinetic_horizon;
+  }
+
+  /* schedule the approach 'key' of a and b 'delta' from now */
+  void add(LifeForm* a, LifeForm* b, const Key& key, SimTime delta) {
+    if (scheduled.count(key) != 0) return;
+    scheduled[key] = new Event(delta, [a, b, key]() { meet(a, b, key); }, approach_tag());
+    keys_of[a].push_back(key);
+    keys_of[b].push_back(key);
+  }
+
+  /* forget 'key' (no longer pending) on lf's side */
+  void drop(const LifeForm* lf, const Key& key) {
+    auto it = keys_of.find(lf);
+    if (it == keys_of.end()) return;
+    std::vector<Key>& keys = it->second;
+    keys.erase(std::remove(keys.begin(), keys.end(), key), keys.end());
+    if (keys.empty()) keys_of.erase(it);
+  }
+
+  void done(const Key& key) {
+    scheduled.erase(key);
+    drop(std::get<0>(key), key);
+    drop(std::get<1>(key), key);
+  }
+
+  static void schedule_pair(LifeForm* a, LifeForm* b) {
+    Approach ap = Approach::between(where_now(a), a->hot_course(), a->hot_speed(),
+                                    where_now(b), b->hot_course(), b->hot_speed(),
+                                    EngineParams::encounter_distance());
+    if (!ap.meets || ap.after > kinetic_horizon) return;
+    pending().add(a, b, key_of(a, b), std::max<SimTime>(ap.after, EngineParams::min_delta_time()));
+  }
+
+  /* (a pending approach's objects are alive: forget() cancels it first) */
+  static void meet(LifeForm* pa, LifeForm* pb, const Key& key) {
+    pending().done(key);
+    SmartPointer<LifeForm> a(pa), b(pb);        // held while resolving
+    if (!a->is_alive || !b->is_alive) return;
+    if (key != key_of(pa, pb)) return;          // one of them has turned since
+    a->update_position();
+    b->update_position();
+    if (!a->is_alive || !b->is_alive) return;
+    double reach = EngineParams::encounter_distance() + Point::tolerance;
+    if (a->position().distance(b->position()) > reach) return;
+#if PARALLEL_ENCOUNTERS
+    EncounterBatch::add(a, b);
+#else
+    a->resolve_encounter(b);
+#endif /* PARALLEL_ENCOUNTERS */
+    if (!a->is_alive || !b->is_alive) return;
+    /* still closing: meet again where they are closest */
+    Approach again = Approach::between(a->position(), a->hot_course(), a->hot_speed(),
+                                       b->position(), b->hot_course(), b->hot_speed(), 0.0);
+    if (again.closest > EngineParams::min_delta_time() && again.closest <= kinetic_horizon)
+      pending().add(pa, pb, key_of(pa, pb), again.closest);
+  }
+
+public:
+  /* schedule lf's approaches for the next kinetic_horizon, and (if it
+     moves) its next plan.  set_course and set_speed bump motion_version
+     first */
+  static void plan(SmartPointer<LifeForm> lf) {
+    if (!lf->is_alive) return;
+    if (lf->hot_speed() > 0.0) lf->update_position();
+    if (!lf->is_alive) return;
+    double radius = scan_radius(&*lf);
+    for (SmartPointer<LifeForm>& other : LifeForm::space().nearby(lf->position(), radius))
+      if (other->is_alive) schedule_pair(&*lf, &*other);
+
+    if (lf->kinetic_refresh != 0) lf->timers.cancel(lf->kinetic_refresh);
+    lf->kinetic_refresh = 0;
+    if (lf->hot_speed() > 0.0) {
+      LifeForm* self = &*lf;
+      lf->kinetic_refresh = lf->timers.schedule(kinetic_horizon, plan_tag(), [self]() {
+        self->kinetic_refresh = 0;
+        plan(SmartPointer<LifeForm>(self));
+      });
+    }
+  }
+
+  /* cancel lf's pending approaches (LifeForm.cpp calls this from die()
+     and withdraw(), before lf leaves the space) */
+  static void forget(const LifeForm* lf) {
+    KineticEncounters& k = pending();
+    auto it = k.keys_of.find(lf);
+    if (it == k.keys_of.end()) return;
+    std::vector<Key> keys;
+    keys.swap(it->second);
+    k.keys_of.erase(it);
+    for (const Key& key : keys) {
+      auto s = k.scheduled.find(key);
+      if (s == k.scheduled.end()) continue;
+      s->second->cancel();
+      k.scheduled.erase(s);
+      k.drop(std::get<0>(key) == lf ? std::get<1>(key) : std::get<0>(key), key);
+    }
+  }
+
+  /* the approaches scheduled and not yet due (stale ones included) */
+  static size_t num_scheduled(void) { return pending().scheduled.size(); }
+};
+
+#endif /* KINETIC_ENCOUNTERS */
+#endif /* !(_KineticEncounters_h) */
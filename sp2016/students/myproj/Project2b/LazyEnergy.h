@@ -0,0 +1,173 @@
+#if !(_LazyEnergy_h)
+#define _LazyEnergy_h 1
+
+#include <cmath>
+
+#include "SimTime.h"
+
+/*
+ * Class name: EnergyAccount
+ * Description:
+ *  Closed-form bookkeeping for the periodic parts of a LifeForm's energy.
+ *
+ *  Every LifeForm loses age_penalty every age_frequency time units, and
+ *  every Algae gains Algae_energy_gain every algae_photo_time time units.
+ *  Between interactions (eating, moving, perceiving, reproducing, ...)
+ *  nothing else changes a LifeForm's energy, so instead of running an age
+ *  event and a photosynthesis event for every object, the account records
+ *  the energy at some time t0 plus the periodic "streams" that apply to
+ *  it.  The energy at any later time is evaluated when somebody looks at
+ *  it (health(), encounters, eat, perceive), and the only event that is
+ *  scheduled is the predicted death (the first tick at which the energy
+ *  drops below min_energy).
+ *
+ *  The ticks happen at the times the periodic events did (first tick one
+ *  period after the stream starts), but they are computed as start + n *
+ *  period, while the event chain added the period one step at a time.
+ *  Under FIXED_POINT_TIME, with periods that are whole numbers of ticks,
+ *  the two are exactly the same, and so is the energy seen at any read
+ *  point.  With double SimTime they can differ in the last bits (about n
+ *  units in the last place after n ticks), so a read that falls within
+ *  that distance of a tick may see the tick where the event-driven
+ *  simulation did not, or the other way round.
+ *
+ * Recommended Usage (LAZY_ENERGY, in LifeForm.cpp):
+ *   account.reset(start_energy, Event::now());
+ *   account.add_stream(age_frequency, -age_penalty, Event::now());
+ *   ...
+ *   energy = account.settle(Event::now());    // at every read point
+ *   account.adjust(-cost, Event::now());      // at every write point
+ *   EnergyAccount::Prediction p = account.predict_below(min_energy);
+ *   // at p.when: die() if p.below, else predict again
+ *
+ *  An EnergyAccount is plain data (checkpoints write it as it is).
+ */
+class EnergyAccount {
+public:
+  static const unsigned max_streams = 4;
+
+  struct Prediction {
+    SimTime when;               // SimTime::max() if the energy never gets there
+    bool below;                 // false: the search stopped at 'when' without
+                                // getting there; predict again at 'when'
+  };
+
+private:
+  struct Stream {
+    double period;
+    double amount;              // energy added at each tick (negative = cost)
+    SimTime next_tick;
+  };
+
+  double base;                  // energy with every tick before 'next_tick' applied
+  SimTime base_time;
+  Stream streams[max_streams];
+  unsigned num_streams;
+
+  /* the number of ticks of 's' in (settled time, t] */
+  static double ticks_until(const Stream& s, SimTime t) {
+    if (t < s.next_tick) return 0.0;
+    return floor(double(t - s.next_tick) / s.period) + 1.0;
+  }
+
+public:
+  EnergyAccount(void) : base(0.0), base_time(0.0), num_streams(0) {}
+
+  void reset(double energy, SimTime now) {
+    base = energy;
+    base_time = now;
+    num_streams = 0;
+  }
+
+  /* from 'now' on, add 'amount' every 'period' time units */
+  void add_stream(double period, double amount, SimTime now) {
+    if (num_streams == max_streams) return;
+    Stream& s = streams[num_streams++];
+    s.period = period;
+    s.amount = amount;
+    s.next_tick = now + period;
+  }
+
+  /* the energy at time 't' (t must not be before the last settle) */
+  double value_at(SimTime t) const {
+    double e = base;
+    for (unsigned k = 0; k < num_streams; k += 1)
+      e += streams[k].amount * ticks_until(streams[k], t);
+    return e;
+  }
+
+  /* apply every tick up to 't' and return the energy */
+  double settle(SimTime t) {
+    for (unsigned k = 0; k < num_streams; k += 1) {
+      Stream& s = streams[k];
+      double n = ticks_until(s, t);
+      if (n > 0.0) {
+        base += s.amount * n;
+        s.next_tick = s.next_tick + n * s.period;
+      }
+    }
+    base_time = t;
+    return base;
+  }
+
+  /* an interaction changed the energy at time 'now' */
+  void adjust(double delta, SimTime now) {
+    settle(now);
+    base += delta;
+  }
+
+  /* average change of energy per time unit */
+  double rate(void) const {
+    double r = 0.0;
+    for (unsigned k = 0; k < num_streams; k += 1)
+      r += streams[k].amount / streams[k].period;
+    return r;
+  }
+
+  /*
+   * the time of the first tick after which the energy is below 'floor'
+   * (SimTime::max() if that never happens).  With a single stream this is
+   * closed form.  With several streams (e.g., algae, which age and
+   * photosynthesize), we jump (in closed form) to shortly before the
+   * average rate crosses the floor and then step through the ticks in
+   * order.  If max_steps ticks do not get there, the prediction is the
+   * last tick stepped to, with below == false: the caller predicts again
+   * then (a death is never lost because the search was cut short).
+   */
+  Prediction predict_below(double floor_energy, unsigned max_steps = 4096) const {
+    const Prediction never = { SimTime::max(), false };
+    if (base < floor_energy) return { base_time, true };
+    if (num_streams == 0) return never;
+
+    if (num_streams == 1) {
+      const Stream& s = streams[0];
+      if (s.amount >= 0.0) return never;
+      double n = floor((base - floor_energy) / -s.amount) + 1.0;
+      return { s.next_tick + (n - 1.0) * s.period, true };
+    }
+
+    EnergyAccount walk = *this;
+    double r = rate();
+    double swing = 0.0;         // how far the ticks can stray from the average
+    for (unsigned k = 0; k < num_streams; k += 1) swing += fabs(streams[k].amount);
+    if (r < 0.0) {
+      double skip = (base - floor_energy - 2.0 * swing) / -r;
+      if (skip > 0.0) walk.settle(base_time + skip);
+    }
+
+    for (unsigned step = 0; step < max_steps; step += 1) {
+      unsigned first = 0;
+      for (unsigned k = 1; k < walk.num_streams; k += 1)
+        if (walk.streams[k].next_tick < walk.streams[first].next_tick) first = k;
+      Stream& s = walk.streams[first];
+      walk.base += s.amount;
+      walk.base_time = s.next_tick;
+      s.next_tick = s.next_tick + s.period;
+      if (walk.base < floor_energy) return { walk.base_time, true };
+      if (r >= 0.0 && walk.base > base + 2.0 * swing) return never;
+    }
+    return { walk.base_time, false };
+  }
+};
+
+#endif /* !(_LazyEnergy_h) */
@@ -1,6 +1,7 @@
 #if ! (_LifeForm_h)
 #define _LifeForm_h 1
 
+#include <atomic>
 #include <cassert>
 #include <vector>
 #include <map>
@@ -14,15 +15,25 @@
 # endif /* end #IF for Windows/Linux time.h file */
 
 #include "Params.h"
+#include "ParamsPolicy.h"
 #include "Point.h"
 #include "SmartPointer.h"
+#include "WakeTimer.h"
+#include "LazyEnergy.h"
+#include "LifeState.h"
+#include "ObjInfo.h"
+#include "PerceptionCache.h"
+#include "Philox.h"
+#include "Span.h"
+#include "Species.h"
+#if POPULATION_RECORDER
+#include "PopulationRecorder.h"
+#endif /* POPULATION_RECORDER */
 
 
 /* forward declarations */
 class LifeForm;
 class istream;
-struct ObjInfo;
-typedef std::vector<ObjInfo> ObjList;
 template <typename Obj> class QuadTree;
 
 /* 
@@ -46,16 +57,40 @@ class Canvas;
 #include "Color.h"
 
 class Event;
+class EncounterBatch;
+class WorkPool;
+class KineticEncounters;
+class SpeciesBatch;
+class CheckpointWriter;
+class CheckpointReader;
 
 enum Action {
   LIFEFORM_IGNORE,
   LIFEFORM_EAT
 };
 
+/* what a decide() call asks for (see SpeciesBatch::request_decision) */
+struct Decision {
+  double course;
+  double speed;
+};
+
 class LifeForm : public ControlBlock {
+public:
+    struct Habitat;             // the LifeForms' part of a World (see below)
+
 private:
-  /* space is the global storage that represents the 2-dimensional simulation area */
-    static QuadTree<SmartPointer<LifeForm>> space;
+    /* the Habitat of the calling thread's World (World::Bind), or of the
+       default world if the thread has not bound one */
+    static Habitat*& bound_habitat(void) {
+      static thread_local Habitat* bound = nullptr;
+      return bound;
+    }
+    static Habitat& default_habitat(void);
+    static Habitat& habitat(void);
+
+  /* space is the storage that represents the 2-dimensional simulation area */
+    static QuadTree<SmartPointer<LifeForm>>& space(void);
 
 
     /* In order to perform the graphics output and to keep track of
@@ -79,7 +114,7 @@ private:
      * LifeForm object where it can find this in the all_life vector
      *
      */
-      static std::vector<LifeForm*> all_life;
+      static std::vector<LifeForm*>& all_life(void);
       uint32_t vector_pos;
 
       /* istream_creators is a map, indexed by strings, and returning functions
@@ -98,32 +133,89 @@ private:
 
       static int scale_x(double); // scale_x and scale_y are used to position the pixel
       static int scale_y(double); // in the window when drawing a LifeForm
-      void print_position(void) const; // print and print_position are provided for debugging purposes
+      void print_position(void) const; // print and print_position are provided
+                                       // for debugging purposes
       void print(void) const;
 
+#if !SOA_STATE
       double energy;
+#endif /* !SOA_STATE */
       bool is_alive;
 
       Event* border_cross_event;    // pointer to the event for the next encounter with a boundary
       void border_cross(void);    // the event handler function for the border cross event
 
-      void region_resize(void);   // the callback function for region resizes (invoked by the quadtree)
+      void region_resize(void);   // the callback function for region resizes
+                                  // (invoked by the quadtree)
 
+#if SOA_STATE
+      /* with SOA_STATE the hot state (position, course, speed, energy and
+       * update_time) is not kept in the object.  It lives in the columns of
+       * hot(), at index 'slot', so that sweeps over every LifeForm (position
+       * updates, redisplay, statistics) are linear passes (see LifeState.h).
+       * The constructor acquires the slot and the destructor releases it.
+       */
+      static LifeStateTable& hot(void);   // the world's table
+      LifeStateTable::Slot slot;
+#else
       Point pos;
       double update_time;           // the time when update_position was 
                                 //   last called
+#endif /* SOA_STATE */
       double reproduce_time;        // the time when reproduce was last called
+#if !SOA_STATE
       double course;
       double speed;
+#endif /* !SOA_STATE */
+
+      /* the hot state, wherever it is stored.  Code that is built both
+         with and without SOA_STATE uses these rather than the fields */
+#if SOA_STATE
+      double& hot_energy(void) { return hot().energy[slot]; }
+      double hot_energy(void) const { return hot().energy[slot]; }
+      double& hot_course(void) { return hot().course[slot]; }
+      double hot_course(void) const { return hot().course[slot]; }
+      double& hot_speed(void) { return hot().speed[slot]; }
+      double hot_speed(void) const { return hot().speed[slot]; }
+      double& hot_update_time(void) { return hot().update_time[slot]; }
+      double hot_update_time(void) const { return hot().update_time[slot]; }
+      Point hot_position(void) const { return hot().position(slot); }
+      void set_hot_position(const Point& p) { hot().set_position(slot, p); }
+#else
+      double& hot_energy(void) { return energy; }
+      double hot_energy(void) const { return energy; }
+      double& hot_course(void) { return course; }
+      double hot_course(void) const { return course; }
+      double& hot_speed(void) { return speed; }
+      double hot_speed(void) const { return speed; }
+      double& hot_update_time(void) { return update_time; }
+      double hot_update_time(void) const { return update_time; }
+      Point hot_position(void) const { return pos; }
+      void set_hot_position(const Point& p) { pos = p; }
+#endif /* SOA_STATE */
 
       Point start_point;      // start_point is sometimes used by the test program(s)
                 // you can (and should) ignore it
 
 
-      void resolve_encounter(SmartPointer<LifeForm>);
+      void resolve_encounter(SmartPointer<LifeForm>);   // (with SPECIES_PROFILING,
+                                // each encounter() call is a CALLBACK_ENCOUNTER scope;
+                                // with CALLBACK_BUDGET, a CallbackWatchdog::Scope)
       void resolve_tiebreak(SmartPointer<LifeForm>); // Helper function to resolve tiebreaks
       void eat(SmartPointer<LifeForm>);
       void age(void);               // subtract age_penalty from energy
+#if LAZY_ENERGY
+      /* with LAZY_ENERGY there are no age (or photosynthesis) events.  The
+         periodic changes are kept in closed form in 'account', 'energy' is
+         brought up to date at every read point and the only scheduled event
+         is the predicted death (see LazyEnergy.h) */
+      EnergyAccount account;
+      WakeTimer::Handle death_action;
+      void sync_energy(void) { hot_energy() = account.settle(Event::now()); }
+      void reschedule_death(void);  // predict death again after energy changes
+                                    // (and when a prediction stopped short:
+                                    // EnergyAccount::Prediction::below)
+#endif /* LAZY_ENERGY */
       void gain_energy(double);     // Add energy to the object
       void lose_energy(double);     // Decrement energy from the object, check if its dead.
       void update_position(void);   // calculate the current position for
@@ -133,30 +225,123 @@ private:
                                 // (we can't have moved very far so there's
                                 // no point in updating our position)
 
+      /* the Params arithmetic of update_position, set_speed and perceive
+         (LifeForm.cpp calls these with the default policy, see
+         ParamsPolicy.h) */
+      template <class P = EngineParams>
+      static double movement_charge(double speed, double elapsed) {
+        return P::movement_cost(speed, elapsed);
+      }
+      template <class P = EngineParams>
+      static double clamp_speed(double s) { return s > P::max_speed() ? P::max_speed() : s; }
+      template <class P = EngineParams>
+      static double clamp_perceive_range(double r) {
+        return r < P::min_perceive_range() ? P::min_perceive_range()
+             : r > P::max_perceive_range() ? P::max_perceive_range() : r;
+      }
+      template <class P = EngineParams>
+      static double perceive_charge(double radius) { return P::perceive_cost(radius); }
+
       void check_encounter(void);   // check to see if there's another object
             // within encounter_distance.  If there's
                                 // an object nearby, invoke resove_encounter
                                 // on ourself with the closest object
+                                // (with PARALLEL_ENCOUNTERS, hand the pair
+                                // to EncounterBatch::add instead; with
+                                // KINETIC_ENCOUNTERS, do nothing: the
+                                // approaches are scheduled by
+                                // KineticEncounters::plan)
   
       void die(void);          // kill the current life form
+#if MEAN_FIELD_ALGAE
+      /* (LifeForm.cpp) leave the world as die() does (energy settled, out
+         of the space, events cancelled), and come back into it as place()
+         does, but neither is reported to the recorder: the object is folded
+         into, or woken from, the mean field (see MeanFieldAlgae.h) */
+      void withdraw(void);
+      static void reinstate(SmartPointer<LifeForm>, Point p);
+#endif /* MEAN_FIELD_ALGAE */
 
 
       void compute_next_move(void); // a simple function that creates the next border_cross_event
 
-      ObjInfo info_about_them(SmartPointer<LifeForm>);
+#if KINETIC_ENCOUNTERS
+      /* bumped by set_course, set_speed and die (which then call
+         KineticEncounters::plan).  A scheduled approach computed for an
+         older version is stale (see KineticEncounters.h).  die and
+         withdraw also call KineticEncounters::forget */
+      uint32_t motion_version = 0;
+      WakeTimer::Handle kinetic_refresh = 0;  // the next plan, while moving
+#endif /* KINETIC_ENCOUNTERS */
 
-      const Point& position() const { return pos; }
+      ObjInfo info_about_them(SmartPointer<LifeForm>);
 
-      static Canvas win;
+      mutable SpeciesId species_cache = 0; // species_id(), once known
+
+      /* the object's number in its world (1, 2, ... in order of creation,
+         so the same in every run that creates objects in the same order) */
+      uint64_t serial = new_serial();
+      static uint64_t new_serial(void);
+      static uint64_t world_seed(void);
+      uint64_t rng_seq = 0;         // the event draw_uniform last drew in
+      uint32_t rng_draws = 0;       // and how many draws it made there
+      Philox4x32::Block rng_block;  // the block of its last draw (each gives two)
+
+#if PERCEPTION_CACHE
+      /* this instant's perceive() results (see PerceptionCache.h) */
+      PerceptionCache perception;
+#endif /* PERCEPTION_CACHE */
+      /* called wherever what others perceive changes, with where it
+         changed: update_position (the old and the new position, when the
+         object actually moved), set_course, set_speed, region_resize, die,
+         and placing a new object */
+      static void world_changed(const Point& where);
+
+      Point position() const { return hot_position(); }
+
+      static Canvas& win(void);   // the world's window
+      static double extent(void); // the world's side (grid_max)
+#if POPULATION_RECORDER
+      /* the world's recorder, or null.  born/died/ate/met/energy are
+         reported to it where they happen (see PopulationRecorder.h) */
+      static PopulationRecorder* recorder(void);
+#endif /* POPULATION_RECORDER */
+      static Canvas& default_canvas(void); // (LifeForm.cpp) the default world's
 protected:
+      /* the object's pending timed actions (border crossing, aging, hunting,
+         digestion, ...).  The global event queue holds just one wakeup event
+         per object; see WakeTimer.h */
+      WakeTimer timers{this};
+
       double health(void) const {
         if (!is_alive) { return 0.0; }
-        else { return energy / start_energy; }
+#if LAZY_ENERGY
+        else { return account.value_at(Event::now()) / start_energy; }
+#else
+        else { return hot_energy() / start_energy; }
+#endif /* LAZY_ENERGY */
       }
+      /* with CALLBACK_BUDGET, set_course, set_speed, reproduce and perceive
+         do nothing (perceive sees nothing) once CallbackWatchdog::check()
+         says the calling species code is over budget */
       void set_course(double);
       void set_speed(double);
-      double get_course(void) const { return course; }
-      double get_speed(void) const { return speed; }
+      double get_course(void) const { return hot_course(); }
+      double get_speed(void) const { return hot_speed(); }
+
+      /* uniform in [0, 1): the next number of the (world seed, serial,
+         running event) Philox stream, so the same on any thread and with
+         any number of threads, and free of shared state (see Philox.h).
+         One block serves two draws.  Species that draw here rather than
+         from drand48 are safe in parallel batches */
+      double draw_uniform(void) {
+        uint64_t seq = Event::running_seq();
+        if (seq != rng_seq) { rng_seq = seq; rng_draws = 0; }
+        uint32_t d = rng_draws++;
+        if (d % 2 == 0) rng_block = PhiloxStream::block_at(world_seed(), serial, seq, d / 2);
+        const uint32_t* w = rng_block.v + 2 * (d % 2);
+        return PhiloxStream::to_uniform(w[0], w[1]);
+      }
       void reproduce(SmartPointer<LifeForm>);
       ObjList perceive(double);
 
@@ -165,6 +350,7 @@ public:
       virtual ~LifeForm(void);
 
       static void add_creator(IstreamCreator, const std::string&);
+                                // (also interns the name, see Species.h)
       static void create_life();
       /* draw the lifeform on 'win' where x,y is upper left corner */
       virtual void draw(int, int) const;
@@ -175,17 +361,72 @@ public:
       static void clear_screen(void);
 
       virtual Action encounter(const ObjInfo&) = 0;
+
+      /*
+       * Optional batch interface (see SpeciesBatch.h).  The engine groups
+       * the calls it has for one species and makes them on the group's first
+       * object: selves[k] (an object of this species) meets them[k], or sees
+       * seen[k], and the answer goes in out[k].  A species overrides these
+       * to share work between its objects.  The defaults make the
+       * per-object calls.
+       */
+      virtual void encounter_batch(Span<LifeForm* const> selves, Span<const ObjInfo> them,
+                                   Span<Action> out) {
+        for (size_t k = 0; k < selves.size(); k += 1) out[k] = selves[k]->encounter(them[k]);
+      }
+      /* where to go next, given what the object sees.  The default keeps the
+         current course and speed */
+      virtual Decision decide(const ObjList&) { return Decision{ get_course(), get_speed() }; }
+      virtual void decide_batch(Span<LifeForm* const> selves, Span<const ObjList> seen,
+                                Span<Decision> out) {
+        for (size_t k = 0; k < selves.size(); k += 1) out[k] = selves[k]->decide(seen[k]);
+      }
+      /* true if this species' encounter() (and encounter_batch) may run on
+         a worker thread (PARALLEL_ENCOUNTERS): it only reads the world and
+         its own objects, and does not steer (set_course, set_speed),
+         perceive, schedule events or draw from drand48.  The species that
+         do not say so are asked on the simulation's thread */
+      virtual bool parallel_safe(void) const { return false; }
       virtual std::string species_name(void) const = 0;
+
+      /* the interned species_name().  Only the first call per object calls
+         species_name(); perceive and info_about_them use this */
+      SpeciesId species_id(void) const {
+        if (species_cache == 0) species_cache = SpeciesRegistry::intern(species_name());
+        return species_cache;
+      }
       virtual std::string player_name(void) const;
 
+      /* species with state of their own (beyond what LifeForm holds) save and
+         restore it here when a checkpoint is written or read */
+      virtual void save_state(CheckpointWriter&) const {}
+      virtual void restore_state(CheckpointReader&) {}
+      /* restoring a checkpoint deletes the events the constructor scheduled
+         (the checkpoint's own are rebound instead): species that remember
+         an Event* clear it here, before restore_state is called */
+      virtual void forget_events(void) {}
+
 friend class Algae;
+friend class Checkpoint;
+friend class Sim;               // coroutine behaviours (Behavior.h)
+friend class Headless;          // batch-mode runner (Headless.cpp)
+friend class ScalingBench;      // scaling benchmark (ScalingBench.cpp)
+friend class EncounterBatch;    // PARALLEL_ENCOUNTERS (EncounterBatch.h)
+friend class KineticEncounters; // KINETIC_ENCOUNTERS (KineticEncounters.h)
+friend class MeanFieldAlgae;    // MEAN_FIELD_ALGAE (MeanFieldAlgae.h)
+friend class SpeciesBatch;      // batched species calls (SpeciesBatch.h)
+friend class World;
+friend Footprint event_footprint(const Event*);  // PARALLEL_EVENTS (EventBatch.h)
+friend unsigned run_event_batch(WorkPool&);      // (shares the space while a round runs)
+friend class WorldSnapshot;     // bulk loading (WorldSnapshot.h)
 
 /*
- * the following functions are used by the test program(s) and should not be used by students (except, of course,
- * during testing, feel free to write your own test programs)
+ * the following functions are used by the test program(s) and should not be
+ * used by students (except, of course, during testing, feel free to write
+ * your own test programs)
  */
     bool confirmPosition(double xpos, double ypos) {
-      return pos.distance(Point(xpos,ypos)) < 0.10;
+      return hot_position().distance(Point(xpos,ypos)) < 0.10;
     }
 
     static void runTests(void);
@@ -194,4 +435,108 @@ friend class Algae;
 
 };
 
+#include "QuadTree.h"
+#if MEAN_FIELD_ALGAE
+#include "MeanFieldAlgae.h"
+#endif /* MEAN_FIELD_ALGAE */
+
+/*
+ * Everything the LifeForms of one simulation share: the space they live
+ * in, the list of every LifeForm, the window they are drawn on (none in a
+ * headless world) and, with SOA_STATE, the table of their hot state.
+ * A World owns one (see World.h).  Single-world programs use the default
+ * habitat, which draws on the default window.
+ */
+struct LifeForm::Habitat {
+  /* (members are destroyed last to first: the LifeForms that 'space'
+     releases still find all_life and hot) */
+  std::vector<LifeForm*> all_life;
+#if SOA_STATE
+  LifeStateTable hot;
+#endif /* SOA_STATE */
+  Canvas* win;                  // null in headless worlds
+  double extent;                // the space is [0, extent) x (0, extent]: grid_max
+  uint64_t seed = 0;            // the key of draw_uniform's streams
+  std::atomic<uint64_t> next_serial{1};
+#if POPULATION_RECORDER
+  PopulationRecorder* recorder = nullptr;
+#endif /* POPULATION_RECORDER */
+#if MEAN_FIELD_ALGAE
+  MeanFieldAlgae field;         // the folded algae (once World::fold_distant_algae)
+#endif /* MEAN_FIELD_ALGAE */
+#if PERCEPTION_CACHE
+  PerceptionGrid perception;    // where the world changed (see PerceptionCache.h)
+#endif /* PERCEPTION_CACHE */
+#if PARALLEL_ENCOUNTERS
+  /* the pairs waiting for the next flush, and the threads that resolve
+     them (both made on first use; see EncounterBatch.h) */
+  std::shared_ptr<EncounterBatch> encounters;
+  std::shared_ptr<WorkPool> workers;
+#endif /* PARALLEL_ENCOUNTERS */
+#if KINETIC_ENCOUNTERS
+  std::shared_ptr<KineticEncounters> kinetic; // the pending approaches (KineticEncounters.h)
+#endif /* KINETIC_ENCOUNTERS */
+  QuadTree<SmartPointer<LifeForm>> space;
+  std::shared_ptr<SpeciesBatch> decisions;   // the pending requests (SpeciesBatch.h)
+
+  explicit Habitat(Canvas* win = nullptr)
+    : win(win), extent(grid_max),
+#if PERCEPTION_CACHE
+      perception(extent),
+#endif /* PERCEPTION_CACHE */
+      space(0.0, 0.0, extent, extent) {}
+
+private:
+  Habitat(const Habitat&) = delete;
+  void operator=(const Habitat&) = delete;
+};
+
+inline LifeForm::Habitat& LifeForm::default_habitat(void) {
+  static Habitat process_habitat(&default_canvas());
+  return process_habitat;
+}
+
+inline LifeForm::Habitat& LifeForm::habitat(void) {
+  Habitat* h = bound_habitat();
+  return h ? *h : default_habitat();
+}
+
+inline QuadTree<SmartPointer<LifeForm>>& LifeForm::space(void) { return habitat().space; }
+inline std::vector<LifeForm*>& LifeForm::all_life(void) { return habitat().all_life; }
+
+inline double LifeForm::extent(void) { return habitat().extent; }
+
+inline Canvas& LifeForm::win(void) {
+  assert(habitat().win != nullptr);   // headless worlds do not draw
+  return *habitat().win;
+}
+
+#if SOA_STATE
+inline LifeStateTable& LifeForm::hot(void) { return habitat().hot; }
+#endif /* SOA_STATE */
+
+inline void LifeForm::world_changed(const Point& where) {
+#if PERCEPTION_CACHE
+  habitat().perception.changed(where);
+#else
+  (void) where;
+#endif /* PERCEPTION_CACHE */
+}
+
+inline uint64_t LifeForm::new_serial(void) { return habitat().next_serial++; }
+inline uint64_t LifeForm::world_seed(void) { return habitat().seed; }
+
+#if POPULATION_RECORDER
+inline PopulationRecorder* LifeForm::recorder(void) { return habitat().recorder; }
+#endif /* POPULATION_RECORDER */
+
+#if MEAN_FIELD_ALGAE
+inline Event* MeanFieldAlgae::rebind_sweep(LifeForm*, double, SimTime delta) {
+  MeanFieldAlgae& f = LifeForm::habitat().field;
+  if (f.cells.empty()) f.resize();
+  f.sweeping = true;
+  return new Event(delta, [&f]() { f.sweep(); }, sweep_tag());
+}
+#endif /* MEAN_FIELD_ALGAE */
+
 #endif /* !(_LifeForm_h) */
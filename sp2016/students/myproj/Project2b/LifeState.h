@@ -0,0 +1,209 @@
+#if !(_LifeState_h)
+#define _LifeState_h 1
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Point.h"
+
+class LifeForm;
+
+/*
+ * Class name: StableColumn
+ * Description:
+ *  A growable array whose elements never move: it grows a page at a time
+ *  and a page, once allocated, stays where it is.  LifeForm's hot_*
+ *  accessors return references into these columns, and those references
+ *  stay valid however many LifeForms are created after them.  Scans walk
+ *  a page at a time (page(), page_length()), so their inner loops are
+ *  still over contiguous memory.
+ */
+template <typename T>
+class StableColumn {
+public:
+  static const size_t page_size = 4096;
+
+private:
+  std::vector<std::unique_ptr<T[]>> pages;
+  size_t n;
+
+  StableColumn(const StableColumn&) = delete;
+  void operator=(const StableColumn&) = delete;
+
+public:
+  StableColumn(void) : n(0) {}
+
+  T& operator[](size_t k) { return pages[k / page_size][k % page_size]; }
+  const T& operator[](size_t k) const { return pages[k / page_size][k % page_size]; }
+  size_t size(void) const { return n; }
+
+  void push_back(const T& v) {
+    if (n % page_size == 0) pages.emplace_back(new T[page_size]);
+    (*this)[n++] = v;
+  }
+
+  size_t num_pages(void) const { return pages.size(); }
+  size_t page_length(size_t p) const {
+    return p + 1 < pages.size() ? size_t(page_size) : n - p * page_size;
+  }
+  T* page(size_t p) { return pages[p].get(); }
+  const T* page(size_t p) const { return pages[p].get(); }
+};
+
+/*
+ * Class name: LifeStateTable
+ * Description:
+ *  Structure-of-arrays storage for the hot part of every LifeForm's state:
+ *  position, course, speed, energy and the time of the last position
+ *  update.  Each LifeForm owns one slot (an index into every column) for
+ *  its whole life; a dead LifeForm's slot is reused by the next LifeForm
+ *  that is created.  The columns are StableColumns, so acquiring a slot
+ *  never moves another slot's fields.
+ *
+ *  Scans over all LifeForms (updating every position, totalling energy,
+ *  counting survivors) walk the columns linearly instead of chasing
+ *  all_life pointers into objects that mix hot fields with cold ones
+ *  (vtable, events, start_point), and the loops below are simple enough
+ *  for the compiler to vectorize.
+ *
+ *  With SOA_STATE defined, LifeForm keeps its hot state here (see the
+ *  hot_* accessors in LifeForm.h).
+ */
+class LifeStateTable {
+public:
+  typedef uint32_t Slot;
+  typedef StableColumn<double> Column;
+  static const size_t page_size = Column::page_size;
+
+  Column x, y;                          // position
+  Column course, speed;
+  Column energy;
+  Column update_time;                   // when the position was last updated
+  StableColumn<uint8_t> alive;          // 0 for free (or dead) slots
+  StableColumn<LifeForm*> owner;        // cold: only for going back to objects
+
+private:
+  std::vector<Slot> free_slots;
+
+public:
+  Slot acquire(LifeForm* lf) {
+    Slot s;
+    if (!free_slots.empty()) {
+      s = free_slots.back();
+      free_slots.pop_back();
+    }
+    else {
+      s = x.size();
+      x.push_back(0.0); y.push_back(0.0);
+      course.push_back(0.0); speed.push_back(0.0);
+      energy.push_back(0.0); update_time.push_back(0.0);
+      alive.push_back(0);
+      owner.push_back(nullptr);
+    }
+    x[s] = y[s] = course[s] = speed[s] = energy[s] = update_time[s] = 0.0;
+    alive[s] = 1;
+    owner[s] = lf;
+    return s;
+  }
+
+  void release(Slot s) {
+    alive[s] = 0;
+    owner[s] = nullptr;
+    speed[s] = 0.0;
+    free_slots.push_back(s);
+  }
+
+  void kill(Slot s) { alive[s] = 0; speed[s] = 0.0; }
+
+  size_t capacity(void) const { return x.size(); }
+
+  Point position(Slot s) const { return Point(x[s], y[s]); }
+  void set_position(Slot s, const Point& p) { x[s] = p.xpos; y[s] = p.ypos; }
+
+  /* where each live object is at time 'now' (without moving it).  Dead
+     and free slots have speed 0, so the loop needs no branches */
+  void positions_at(double now, std::vector<double>& px, std::vector<double>& py) const {
+    px.resize(x.size());
+    py.resize(x.size());
+    for (size_t p = 0; p < x.num_pages(); p += 1) {
+      const double* xs = x.page(p);
+      const double* ys = y.page(p);
+      const double* cs = course.page(p);
+      const double* ss = speed.page(p);
+      const double* ts = update_time.page(p);
+      double* pxs = &px[p * page_size];
+      double* pys = &py[p * page_size];
+      size_t n = x.page_length(p);
+      for (size_t k = 0; k < n; k += 1) {
+        double d = ss[k] * (now - ts[k]);
+        pxs[k] = xs[k] + d * cos(cs[k]);
+        pys[k] = ys[k] + d * sin(cs[k]);
+      }
+    }
+  }
+
+  /* move every live object to where it is at 'now' and charge the
+     movement cost (cost(speed, elapsed) per object).  For benchmarks
+     only: it neither updates the objects' QuadTree entries nor kills the
+     ones whose energy falls below min_energy, so it must not be run on a
+     live world */
+  template <typename CostFunction>
+  void advance_all(double now, CostFunction cost) {
+    for (size_t p = 0; p < x.num_pages(); p += 1) {
+      double* xs = x.page(p);
+      double* ys = y.page(p);
+      const double* cs = course.page(p);
+      const double* ss = speed.page(p);
+      double* es = energy.page(p);
+      double* ts = update_time.page(p);
+      const uint8_t* as = alive.page(p);
+      size_t n = x.page_length(p);
+      for (size_t k = 0; k < n; k += 1) {
+        double elapsed = now - ts[k];
+        double d = ss[k] * elapsed;
+        xs[k] += d * cos(cs[k]);
+        ys[k] += d * sin(cs[k]);
+        es[k] -= as[k] ? cost(ss[k], elapsed) : 0.0;
+        ts[k] = now;
+      }
+    }
+  }
+
+  double total_energy(void) const {
+    double sum = 0.0;
+    for (size_t p = 0; p < energy.num_pages(); p += 1) {
+      const double* es = energy.page(p);
+      const uint8_t* as = alive.page(p);
+      size_t n = energy.page_length(p);
+      for (size_t k = 0; k < n; k += 1) sum += as[k] ? es[k] : 0.0;
+    }
+    return sum;
+  }
+
+  size_t count_alive(void) const {
+    size_t count = 0;
+    for (size_t p = 0; p < alive.num_pages(); p += 1) {
+      const uint8_t* as = alive.page(p);
+      size_t n = alive.page_length(p);
+      for (size_t k = 0; k < n; k += 1) count += as[k];
+    }
+    return count;
+  }
+
+  /* the number of live objects whose energy is below 'floor' */
+  size_t count_below(double floor_energy) const {
+    size_t count = 0;
+    for (size_t p = 0; p < energy.num_pages(); p += 1) {
+      const double* es = energy.page(p);
+      const uint8_t* as = alive.page(p);
+      size_t n = energy.page_length(p);
+      for (size_t k = 0; k < n; k += 1) count += as[k] & (es[k] < floor_energy);
+    }
+    return count;
+  }
+};
+
+#endif /* !(_LifeState_h) */
@@ -0,0 +1,95 @@
+#if !(_ListPool_h)
+#define _ListPool_h 1
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/*
+ * Class name: ListBufferPool
+ * Description:
+ *  Per-thread free lists of list buffers, by power-of-two size class
+ *  (256 bytes up to 1MB).  A perceive() result is built, read by the
+ *  species and thrown away, usually within one event, so the buffer it
+ *  frees is the one the next perceive() on the same thread picks up: in
+ *  steady state, building an ObjList allocates nothing.
+ *
+ *  Buffers freed on another thread than the one that allocated them go
+ *  into that thread's pool.  Each thread's pool is emptied when the thread
+ *  exits.  A buffer released after that (the default Habitat is destroyed
+ *  after the main thread's pool) is freed at once.
+ */
+class ListBufferPool {
+  static const unsigned min_shift = 8;
+  static const unsigned num_classes = 13;
+  static const size_t max_pooled = 16;  // buffers kept per size class
+
+  struct Lists {
+    std::vector<void*> free[num_classes];
+    ~Lists(void) {
+      gone() = true;
+      for (auto& list : free)
+        for (void* p : list) ::operator delete(p);
+    }
+  };
+
+  static Lists& lists(void) {
+    static thread_local Lists l;
+    return l;
+  }
+
+  /* true once this thread's Lists is destroyed */
+  static bool& gone(void) {
+    static thread_local bool g = false;
+    return g;
+  }
+
+  static unsigned size_class(size_t bytes) {
+    unsigned k = 0;
+    while ((size_t(1) << (k + min_shift)) < bytes) k += 1;
+    return k;
+  }
+
+public:
+  static void* allocate(size_t bytes) {
+    unsigned k = size_class(bytes);
+    if (k >= num_classes || gone()) return ::operator new(bytes);
+    std::vector<void*>& list = lists().free[k];
+    if (list.empty()) return ::operator new(size_t(1) << (k + min_shift));
+    void* p = list.back();
+    list.pop_back();
+    return p;
+  }
+
+  static void release(void* p, size_t bytes) {
+    if (gone()) { ::operator delete(p); return; }
+    unsigned k = size_class(bytes);
+    std::vector<void*>& list = lists().free[k < num_classes ? k : 0];
+    if (k >= num_classes || list.size() >= max_pooled) { ::operator delete(p); return; }
+    list.push_back(p);
+  }
+};
+
+/*
+ * Class name: PoolAllocator
+ * Description:
+ *  A stateless std::allocator replacement that takes its buffers from
+ *  ListBufferPool.  Since std::vector only ever asks for a new buffer when
+ *  it grows, reserve() what is needed up front to get a single pooled
+ *  buffer per list.
+ */
+template <typename T>
+struct PoolAllocator {
+  typedef T value_type;
+
+  PoolAllocator(void) {}
+  template <typename U> PoolAllocator(const PoolAllocator<U>&) {}
+
+  T* allocate(size_t n) { return static_cast<T*>(ListBufferPool::allocate(n * sizeof(T))); }
+  void deallocate(T* p, size_t n) { ListBufferPool::release(p, n * sizeof(T)); }
+
+  template <typename U> bool operator==(const PoolAllocator<U>&) const { return true; }
+  template <typename U> bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
+
+#endif /* !(_ListPool_h) */
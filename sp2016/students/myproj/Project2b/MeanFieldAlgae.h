@@ -0,0 +1,344 @@
+/*
+ * LifeForm.h includes this file after class LifeForm (a Habitat holds a
+ * MeanFieldAlgae), so a file that includes it first gets LifeForm.h
+ */
+#if !(_LifeForm_h)
+#include "LifeForm.h"
+#elif !(_MeanFieldAlgae_h)
+#define _MeanFieldAlgae_h 1
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "Event.h"
+#include "EventProfile.h"
+#include "LazyEnergy.h"
+#include "Params.h"
+#include "Point.h"
+#include "SimTime.h"
+#include "Species.h"
+
+/* the side of a field cell (at least; see MeanFieldAlgae::resize) */
+const double mean_field_cell = 50.0;
+
+/* the field is swept (cells folded and woken) this often */
+const SimTime mean_field_period = 2.0;
+
+/*
+ * Mean-field Algae (MEAN_FIELD_ALGAE).
+ *
+ * Algae do not move, and nothing but their own photosynthesis and aging
+ * changes them until something comes to eat them.  In an algae-dominated
+ * world most of the events are those periodic changes, on algae that no
+ * other object will see for a long time.
+ *
+ * With MEAN_FIELD_ALGAE the space is divided into square cells.  Every
+ * mean_field_period a sweep marks the cells that some object other than
+ * an Algae could perceive or reach before the next sweep: those within
+ *   max_perceive_range + encounter_distance
+ *     + max_speed * (mean_field_period + time since its position was updated)
+ * of it.  The Algae in every other cell are folded into the cell's field:
+ * they leave the world (LifeForm::withdraw: no object, no events, no
+ * QuadTree entry) and the cell keeps where each one was and its energy.
+ * The periodic changes are the same for every alga, so the cell keeps them
+ * once, in closed form: an EnergyAccount with the photosynthesis
+ * (Algae_energy_gain every algae_photo_time) and aging (-age_penalty every
+ * age_frequency) streams, started when the cell folded.  An alga's energy
+ * is its offset plus the account's value, and an alga whose energy falls
+ * below min_energy dies in the field (checked at each sweep, on the cell's
+ * lowest offset).
+ *
+ * A cell that becomes hot is woken: each alga is created again
+ * (LifeForm::reinstate) where it was, with its energy.  Objects that are
+ * placed or born (LifeForm.cpp calls arrived() for those that are not
+ * Algae) wake the cells around them at once.
+ *
+ * The approximations: an alga in the field gains and loses energy at the
+ * cell's tick times rather than its own, dies up to mean_field_period
+ * late, and comes back as a new object (a new serial, and photosynthesis
+ * and aging started afresh).  What other objects can see is exact: an alga
+ * is always in the world while anything could perceive it.
+ *
+ * Folding and waking are not births and deaths: the population recorder
+ * (POPULATION_RECORDER) still counts the folded algae, and each sweep
+ * reports the energy they gained.  World::census counts them too.  A
+ * checkpoint or snapshot holds the cells as they are (save and restore;
+ * nothing is woken, so saving does not change the run).  Saving the sweep
+ * event needs the Checkpoint rebinder that LifeForm.cpp registers (with
+ * the engine's own) under the tag "MeanFieldAlgae::sweep".
+ *
+ * Recommended Usage:
+ *   World w(seed);
+ *   World::Bind bind(&w);
+ *   w.populate({ { "Algae", 1000000 }, { "Craig", 20 } });
+ *   w.fold_distant_algae();          // sweeps from now on
+ *   w.run_until(1000.0);
+ */
+class MeanFieldAlgae {
+  struct Cell {
+    std::vector<Point> where;   // the folded algae,
+    std::vector<double> offset; // and their energy less the field's value
+    double low = std::numeric_limits<double>::infinity(); // the least offset
+    double reported = 0.0;      // the field's value at the last sweep
+    EnergyAccount field;        // photosynthesis and aging since it folded
+  };
+
+  std::vector<Cell> cells;      // row-major, side x side
+  unsigned side = 0;
+  double cell_size = mean_field_cell;
+  size_t folded = 0;            // algae in the field
+  bool sweeping = false;
+
+  unsigned column(double c) const {
+    double k = std::floor(c / cell_size);
+    return k < 0.0 ? 0 : k >= side ? side - 1 : unsigned(k);
+  }
+  size_t cell_of(const Point& p) const { return size_t(column(p.ypos)) * side + column(p.xpos); }
+
+  /* the cells at most 'radius' from p (a bounding square) */
+  template <typename Visit>
+  void around(const Point& p, double radius, Visit visit) const {
+    unsigned x0 = column(p.xpos - radius), x1 = column(p.xpos + radius);
+    unsigned y0 = column(p.ypos - radius), y1 = column(p.ypos + radius);
+    for (unsigned y = y0; y <= y1; y += 1)
+      for (unsigned x = x0; x <= x1; x += 1) visit(size_t(y) * side + x);
+  }
+
+  /* how far any object's perception may reach within 'ahead' time units */
+  static double reach(SimTime ahead) {
+    return EngineParams::max_perceive_range() + EngineParams::encounter_distance() +
+           EngineParams::max_speed() * double(ahead);
+  }
+
+  static SpeciesId algae(void) {
+    static const SpeciesId id = SpeciesRegistry::intern("Algae");
+    return id;
+  }
+
+  /* no more than 256 x 256 cells, however large the world */
+  void resize(void) {
+    double extent = LifeForm::extent();
+    cell_size = std::max(mean_field_cell, extent / 256.0);
+    side = std::max(1u, unsigned(std::ceil(extent / cell_size)));
+    cells.assign(size_t(side) * side, Cell());
+  }
+
+  void fold(LifeForm* lf, SimTime now) {
+    Cell& c = cells[cell_of(lf->position())];
+    if (c.where.empty()) {
+      c.field.reset(0.0, now);
+      c.field.add_stream(EngineParams::algae_photo_time(), EngineParams::Algae_energy_gain(), now);
+      c.field.add_stream(EngineParams::age_frequency(), -EngineParams::age_penalty(), now);
+      c.reported = 0.0;
+      c.low = std::numeric_limits<double>::infinity();
+    }
+    double offset = lf->health() * start_energy - c.field.value_at(now);
+    c.where.push_back(lf->position());
+    c.offset.push_back(offset);
+    c.low = std::min(c.low, offset);
+    folded += 1;
+    lf->withdraw();
+  }
+
+  /* the energy the cell's algae gained since the last sweep */
+  void report(Cell& c, SimTime now) {
+    double value = c.field.value_at(now);
+#if POPULATION_RECORDER
+    if (PopulationRecorder* rec = LifeForm::recorder())
+      rec->energy(algae(), (value - c.reported) * c.where.size());
+#endif /* POPULATION_RECORDER */
+    c.reported = value;
+  }
+
+  /* algae whose energy fell below min_energy die in the field */
+  void starve(Cell& c, SimTime now) {
+    double value = c.field.value_at(now);
+    if (c.low + value >= EngineParams::min_energy()) return;
+    size_t kept = 0;
+    c.low = std::numeric_limits<double>::infinity();
+    for (size_t k = 0; k < c.where.size(); k += 1) {
+      if (c.offset[k] + value < EngineParams::min_energy()) {
+#if POPULATION_RECORDER
+        if (PopulationRecorder* rec = LifeForm::recorder())
+          rec->died(algae(), c.offset[k] + value);
+#endif /* POPULATION_RECORDER */
+        folded -= 1;
+        continue;
+      }
+      c.where[kept] = c.where[k];
+      c.offset[kept] = c.offset[k];
+      c.low = std::min(c.low, c.offset[kept]);
+      kept += 1;
+    }
+    c.where.resize(kept);
+    c.offset.resize(kept);
+  }
+
+  /* bring the cell's algae back into the world */
+  void wake(Cell& c, SimTime now) {
+    if (c.where.empty()) return;
+    report(c, now);
+    starve(c, now);
+    LFCreatorTable& creators = LifeForm::istream_creators();
+    auto create = creators.find("Algae");
+    double value = c.field.value_at(now);
+    std::vector<Point> where;
+    std::vector<double> offset;
+    where.swap(c.where);
+    offset.swap(c.offset);
+    folded -= where.size();
+    if (create == creators.end()) return;
+    for (size_t k = 0; k < where.size(); k += 1) {
+      /* a spot taken meanwhile (by a spore) is as if the spore had
+         found it taken */
+      if (LifeForm::space().is_occupied(where[k])) {
+#if POPULATION_RECORDER
+        if (PopulationRecorder* rec = LifeForm::recorder()) rec->died(algae(), offset[k] + value);
+#endif /* POPULATION_RECORDER */
+        continue;
+      }
+      SmartPointer<LifeForm> lf = create->second();
+      LifeForm::reinstate(lf, where[k]);
+      set_energy(&*lf, offset[k] + value, now);
+    }
+  }
+
+  static void set_energy(LifeForm* lf, double energy, SimTime now) {
+#if LAZY_ENERGY
+    lf->sync_energy();
+    lf->account.adjust(energy - lf->hot_energy(), now);
+    lf->sync_energy();
+    lf->reschedule_death();
+#else
+    (void) now;
+    lf->hot_energy() = energy;
+#endif /* LAZY_ENERGY */
+  }
+
+  void sweep(void) {
+    SimTime now = Event::now();
+    std::vector<uint8_t> hot(cells.size(), 0);
+    std::vector<LifeForm*> quiet;
+    for (LifeForm* lf : LifeForm::all_life()) {
+      if (!lf->is_alive || lf->species_id() == algae()) continue;
+      around(lf->position(), reach(mean_field_period + (now - lf->hot_update_time())),
+             [&hot](size_t k) { hot[k] = 1; });
+    }
+    for (size_t k = 0; k < cells.size(); k += 1) {
+      Cell& c = cells[k];
+      if (c.where.empty()) continue;
+      if (hot[k]) {
+        wake(c, now);
+      } else {
+        report(c, now);
+        starve(c, now);
+      }
+    }
+    for (LifeForm* lf : LifeForm::all_life()) {
+      if (lf->is_alive && lf->species_id() == algae() && !hot[cell_of(lf->position())])
+        quiet.push_back(lf);
+    }
+    for (LifeForm* lf : quiet) fold(lf, now);
+
+    /* a world with nothing left in it stops sweeping */
+    sweeping = folded > 0 || !LifeForm::all_life().empty();
+    if (sweeping) schedule();
+  }
+
+  static EventTag sweep_tag(void) {
+    static EventTag tag = EventProfiler::engine_tag("MeanFieldAlgae::sweep");
+    return tag;
+  }
+  void schedule(void) { new Event(mean_field_period, [this]() { sweep(); }, sweep_tag()); }
+
+public:
+  /* sweep now and then every mean_field_period */
+  void start(void) {
+    if (sweeping) return;
+    if (cells.empty()) resize();
+    sweeping = true;
+    sweep();
+  }
+
+  /* an object that is not an Algae entered the world at p: wake the
+     cells it could perceive before the next sweep (LifeForm.cpp calls this
+     from place() and reproduce()) */
+  void arrived(const Point& p) {
+    if (folded == 0) return;
+    SimTime now = Event::now();
+    around(p, reach(mean_field_period), [this, now](size_t k) { wake(cells[k], now); });
+  }
+
+  /* wake every cell */
+  void materialize_all(void) {
+    SimTime now = Event::now();
+    for (Cell& c : cells) wake(c, now);
+  }
+
+  /* the algae in the field */
+  size_t size(void) const { return folded; }
+
+  /* write the cells that hold algae (Checkpoint and WorldSnapshot; the
+     Writer is a CheckpointWriter) */
+  template <class Writer>
+  void save(Writer& w) const {
+    uint32_t held = 0;
+    for (const Cell& c : cells) held += !c.where.empty();
+    w.template put<double>(cell_size);
+    w.template put<uint32_t>(side);
+    w.template put<uint8_t>(sweeping);
+    w.template put<uint32_t>(held);
+    for (size_t k = 0; k < cells.size(); k += 1) {
+      const Cell& c = cells[k];
+      if (c.where.empty()) continue;
+      w.template put<uint32_t>(k);
+      w.template put<double>(c.low);
+      w.template put<double>(c.reported);
+      w.template put<EnergyAccount>(c.field);
+      w.template put<uint64_t>(c.where.size());
+      for (size_t j = 0; j < c.where.size(); j += 1) {
+        w.template put<double>(c.where[j].xpos);
+        w.template put<double>(c.where[j].ypos);
+        w.template put<double>(c.offset[j]);
+      }
+    }
+  }
+
+  /* read what save wrote into an empty field; false if it is damaged */
+  template <class Reader>
+  bool restore(Reader& r) {
+    cell_size = r.template get<double>();
+    side = r.template get<uint32_t>();
+    sweeping = r.template get<uint8_t>() != 0;
+    uint32_t held = r.template get<uint32_t>();
+    if (!r.ok() || !(cell_size > 0.0) || side > 65536) return false;
+    cells.assign(size_t(side) * side, Cell());
+    folded = 0;
+    for (uint32_t h = 0; h < held && r.ok(); h += 1) {
+      uint32_t k = r.template get<uint32_t>();
+      if (k >= cells.size() || !cells[k].where.empty()) return false;
+      Cell& c = cells[k];
+      c.low = r.template get<double>();
+      c.reported = r.template get<double>();
+      c.field = r.template get<EnergyAccount>();
+      uint64_t count = r.template get<uint64_t>();
+      for (uint64_t j = 0; j < count && r.ok(); j += 1) {
+        double xpos = r.template get<double>();
+        double ypos = r.template get<double>();
+        c.where.push_back(Point(xpos, ypos));
+        c.offset.push_back(r.template get<double>());
+      }
+      folded += c.where.size();
+    }
+    return r.ok();
+  }
+
+  /* the Checkpoint rebinder of the sweep event (the restored world
+     sweeps again 'delta' from now) */
+  static Event* rebind_sweep(LifeForm*, double, SimTime delta);
+};
+
+#endif /* !(_MeanFieldAlgae_h) */
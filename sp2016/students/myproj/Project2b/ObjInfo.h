@@ -1,15 +1,27 @@
 #if !(_ObjInfo_h)
 #define _ObjInfo_h 1
 #include <string>
+#include <type_traits>
+#include <vector>
 
+#include "ListPool.h"
+#include "Species.h"
+
+/*
+ * An ObjInfo is a plain 32-byte record (two per cache line) that is
+ * copied with memcpy.  'distance' stays a double since it is compared
+ * against encounter_distance and the perceive radius; health, angles and
+ * speeds are floats, which is far more precision than they carry.
+ */
 //#include "Default_ops.h"
 struct ObjInfo {
-  std::string species;               // species of the object
-  double health;                // their health
+  SpeciesName species;          // species of the object (an interned id
+                                // that compares and converts like a string)
+  float health;                 // their health
   double distance;              // distance between us
-  double bearing;               // course I can take to get where it is now
-  double their_speed;           
-  double their_course;          
+  float bearing;                // course I can take to get where it is now
+  float their_speed;
+  float their_course;
   bool operator == (const ObjInfo& o) const {
     return species == o.species &&
       distance == o.distance &&
@@ -18,19 +30,34 @@ struct ObjInfo {
       their_course == o.their_course;
   };
 
-  void copy(const ObjInfo& o) { // this is exactly what the default copy
-                                // constructor would do.
-    species = o.species;
-    health = o.health;
-    distance = o.distance;
-    bearing = o.bearing;
-    their_speed = o.their_speed;
-    their_course = o.their_course;
-  }
+  void copy(const ObjInfo& o) { *this = o; }
 
   ObjInfo(void) {} // use this constructor with care!
-  ObjInfo(const ObjInfo& o) { copy(o); }
-  ObjInfo& operator=(const ObjInfo& o) { copy(o); return *this; }
+  /* copying is the compiler's (ObjInfo is trivially copyable) */
+};
+
+static_assert(std::is_trivially_copyable<ObjInfo>::value,
+              "ObjInfo must stay trivially copyable");
+static_assert(sizeof(ObjInfo) == 32, "ObjInfo should fill half a cache line");
+
+/*
+ * perceive() results.  The buffers come from a per-thread pool (see
+ * ListPool.h), so building and dropping lists does not allocate.
+ *
+ * ObjList used to be std::vector<ObjInfo>.  It converts to and from that
+ * type (by copying), so species code that stores a perceive() result in
+ * a std::vector<ObjInfo>, or passes one where an ObjList is expected,
+ * still compiles.  What does not: binding a std::vector<ObjInfo>& to an
+ * ObjList, and overloading on the two types.
+ */
+class ObjList : public std::vector<ObjInfo, PoolAllocator<ObjInfo>> {
+  typedef std::vector<ObjInfo, PoolAllocator<ObjInfo>> Base;
+
+public:
+  using Base::Base;
+  ObjList(void) {}
+  ObjList(const std::vector<ObjInfo>& v) : Base(v.begin(), v.end()) {}
+  operator std::vector<ObjInfo>(void) const { return std::vector<ObjInfo>(begin(), end()); }
 };
 
 #endif /* !(_ObjInfo_h) */
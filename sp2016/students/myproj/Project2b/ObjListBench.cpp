@@ -0,0 +1,149 @@
+/*
+ * ObjListBench.cpp
+ *
+ * The cost of building and consuming perceive() results, before and
+ * after ObjInfo became a trivially copyable 32-byte record and ObjList a
+ * pooled vector.  Each "perceive" builds a list of 'k' neighbours (as
+ * LifeForm::perceive does, one push_back per neighbour), the species
+ * scans it for the closest Algae, and the list is dropped.
+ *
+ * The "legacy" record is the old ObjInfo: a std::string species, six
+ * doubles and a user-provided copy constructor and assignment.
+ *
+ * Build and run:
+ *   g++ -std=c++14 -O2 ObjListBench.cpp -o ObjListBench && ./ObjListBench
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "ObjInfo.h"
+
+namespace {
+
+uint64_t allocations = 0;
+
+struct LegacyObjInfo {
+  std::string species;
+  double health;
+  double distance;
+  double bearing;
+  double their_speed;
+  double their_course;
+
+  void copy(const LegacyObjInfo& o) {
+    species = o.species;
+    health = o.health;
+    distance = o.distance;
+    bearing = o.bearing;
+    their_speed = o.their_speed;
+    their_course = o.their_course;
+  }
+
+  LegacyObjInfo(void) {}
+  LegacyObjInfo(const LegacyObjInfo& o) { copy(o); }
+  LegacyObjInfo& operator=(const LegacyObjInfo& o) { copy(o); return *this; }
+};
+
+typedef std::vector<LegacyObjInfo> LegacyObjList;
+
+/* the names a legacy perceive gets from species_name() (by value; the
+   simulator's own species, all short enough for the small string buffer) */
+const char* legacy_names[] = { "Algae", "Craig", "wf2796" };
+
+LegacyObjList legacy_perceive(unsigned k, unsigned salt) {
+  LegacyObjList result;
+  for (unsigned j = 0; j < k; j += 1) {
+    LegacyObjInfo info;
+    info.species = std::string(legacy_names[(j + salt) % 3]);
+    info.health = 0.5 + j;
+    info.distance = 1.0 + (j * 7 + salt) % 50;
+    info.bearing = 0.1 * j;
+    info.their_speed = 2.0;
+    info.their_course = 0.3 * j;
+    result.push_back(info);
+  }
+  return result;
+}
+
+ObjList pooled_perceive(unsigned k, unsigned salt, const SpeciesName* names) {
+  ObjList result;
+  result.reserve(k);
+  for (unsigned j = 0; j < k; j += 1) {
+    ObjInfo info;
+    info.species = names[(j + salt) % 3];
+    info.health = 0.5f + j;
+    info.distance = 1.0 + (j * 7 + salt) % 50;
+    info.bearing = 0.1f * j;
+    info.their_speed = 2.0f;
+    info.their_course = 0.3f * j;
+    result.push_back(info);
+  }
+  return result;
+}
+
+struct Result {
+  double seconds;
+  uint64_t allocations;
+  double checksum;
+};
+
+template <typename Perceive, typename IsFood>
+Result run(unsigned calls, unsigned k, Perceive perceive, IsFood is_food) {
+  Result r;
+  r.checksum = 0.0;
+  uint64_t before = allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned c = 0; c < calls; c += 1) {
+    auto list = perceive(k, c);
+    double best = 1.0e9;
+    for (const auto& info : list)
+      if (is_food(info) && info.distance < best) best = info.distance;
+    r.checksum += best;
+  }
+  auto stop = std::chrono::steady_clock::now();
+  r.seconds = std::chrono::duration<double>(stop - start).count();
+  r.allocations = allocations - before;
+  return r;
+}
+
+} // namespace
+
+void* operator new(size_t n) {
+  allocations += 1;
+  void* p = malloc(n ? n : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+int main(int argc, char* argv[]) {
+  unsigned calls = argc > 1 ? atoi(argv[1]) : 1000000;
+  SpeciesName names[3] = { SpeciesName(std::string(legacy_names[0])),
+                           SpeciesName(std::string(legacy_names[1])),
+                           SpeciesName(std::string(legacy_names[2])) };
+  SpeciesName algae = names[0];
+
+  printf("sizeof: legacy ObjInfo %zu bytes, ObjInfo %zu bytes\n",
+         sizeof(LegacyObjInfo), sizeof(ObjInfo));
+  printf("%6s %14s %14s %14s %14s %8s\n", "k", "legacy Mcall/s", "alloc/call",
+         "pooled Mcall/s", "alloc/call", "speedup");
+  for (unsigned k : { 4u, 16u, 64u }) {
+    Result legacy = run(calls, k, legacy_perceive,
+                        [](const LegacyObjInfo& i) { return i.species == legacy_names[0]; });
+    Result pooled = run(calls, k,
+                        [&](unsigned n, unsigned salt) { return pooled_perceive(n, salt, names); },
+                        [&](const ObjInfo& i) { return i.species == algae; });
+    if (legacy.checksum != pooled.checksum) printf("(results differ)\n");
+    printf("%6u %14.2f %14.2f %14.2f %14.2f %8.2f\n", k,
+           calls / legacy.seconds / 1.0e6, double(legacy.allocations) / calls,
+           calls / pooled.seconds / 1.0e6, double(pooled.allocations) / calls,
+           legacy.seconds / pooled.seconds);
+  }
+  return 0;
+}
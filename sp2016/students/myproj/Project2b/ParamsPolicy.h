@@ -0,0 +1,54 @@
+#if !(_ParamsPolicy_h)
+#define _ParamsPolicy_h 1
+
+#include "Params.h"
+
+/*
+ * The Params policy.
+ *
+ * The rules of the simulation (Params.h) are extern consts and out-of-line
+ * functions defined in Params.cpp.  Engine code that evaluates them on a
+ * hot path (update_position, perceive, the encounter batch, ...) reads
+ * them through a policy with one static function per parameter, so that
+ * it is templated on where the rules come from.  EngineParams is the one
+ * the engine uses:
+ *   LinkedParams  the values Params.cpp links in
+ *
+ * (A constexpr policy, which would let the compiler fold the rules into
+ * the caller, needs the course's real values, which are not in this
+ * tree.)
+ *
+ * Recommended Usage (engine code):
+ *   template <class P = EngineParams>
+ *   double charge(double speed, double t) { return P::movement_cost(speed, t); }
+ */
+struct LinkedParams {
+  static double digestion_time(void) { return ::digestion_time; }
+  static double eat_efficiency(void) { return ::eat_efficiency; }
+  static double start_energy(void) { return ::start_energy; }
+  static double age_penalty(void) { return ::age_penalty; }
+  static double age_frequency(void) { return ::age_frequency; }
+  static double encounter_penalty(void) { return ::encounter_penalty; }
+  static double min_energy(void) { return ::min_energy; }
+  static double reproduce_dist(void) { return ::reproduce_dist; }
+  static double reproduce_cost(void) { return ::reproduce_cost; }
+  static double min_reproduce_time(void) { return ::min_reproduce_time; }
+  static double Algae_energy_gain(void) { return ::Algae_energy_gain; }
+  static double algae_photo_time(void) { return ::algae_photo_time; }
+  static double encounter_distance(void) { return ::encounter_distance; }
+  static double max_speed(void) { return ::max_speed; }
+  static double max_perceive_range(void) { return ::max_perceive_range; }
+  static double min_perceive_range(void) { return ::min_perceive_range; }
+  static double min_delta_time(void) { return ::min_delta_time; }
+
+  static double eat_cost_function(double e1 = 0, double e2 = 0) {
+    return ::eat_cost_function(e1, e2);
+  }
+  static double eat_success_chance(double e1, double e2) { return ::eat_success_chance(e1, e2); }
+  static double movement_cost(double speed, double time) { return ::movement_cost(speed, time); }
+  static double perceive_cost(double radius) { return ::perceive_cost(radius); }
+};
+
+typedef LinkedParams EngineParams;
+
+#endif /* !(_ParamsPolicy_h) */
@@ -0,0 +1,198 @@
+#if !(_PerceptionCache_h)
+#define _PerceptionCache_h 1
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>             // (for Point.h)
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ObjInfo.h"
+#include "Point.h"
+#include "SimTime.h"
+
+class LifeForm;
+
+/* the side of a PerceptionGrid cell (at least; see PerceptionGrid) */
+const double perception_cell = 32.0;
+
+/* perceive radii are rounded up to a multiple of this (see PerceptionCache) */
+const double perception_bucket = 10.0;
+
+/*
+ * Class name: PerceptionGrid
+ * Description:
+ *  Where the world last changed, for PerceptionCache.  The space is
+ *  divided into square cells (no more than 256 x 256), and each cell
+ *  counts the changes made in it: an object moved into or out of it,
+ *  turned, changed speed, was born or died there.  A perception only
+ *  depends on the cells its circle covers, so it stays valid while their
+ *  counts (and the count of changes that are not in any one place) do not
+ *  move.  Every world (LifeForm::Habitat) has its own.
+ */
+class PerceptionGrid {
+  std::unique_ptr<std::atomic<uint32_t>[]> cells;
+  unsigned side;
+  double cell_size;
+  std::atomic<uint64_t> everywhere;
+
+  unsigned column(double c) const {
+    double k = std::floor(c / cell_size);
+    return k < 0.0 ? 0 : k >= side ? side - 1 : unsigned(k);
+  }
+
+  PerceptionGrid(const PerceptionGrid&) = delete;
+  void operator=(const PerceptionGrid&) = delete;
+
+public:
+  explicit PerceptionGrid(double extent)
+    : cell_size(std::max(perception_cell, extent / 256.0)), everywhere(1) {
+    side = std::max(1u, unsigned(std::ceil(extent / cell_size)));
+    cells.reset(new std::atomic<uint32_t>[size_t(side) * side]);
+    for (size_t k = 0; k < size_t(side) * side; k += 1)
+      cells[k].store(0, std::memory_order_relaxed);
+  }
+
+  /* something that others can perceive changed at 'where' */
+  void changed(const Point& where) {
+    cells[size_t(column(where.ypos)) * side + column(where.xpos)]
+      .fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /* something changed that is not in any one place */
+  void changed_everywhere(void) { everywhere.fetch_add(1, std::memory_order_relaxed); }
+
+  /* the changes made within 'radius' of 'centre' (and everywhere) so far:
+     a perception is still valid while this stays the same */
+  uint64_t stamp(const Point& centre, double radius) const {
+    uint64_t sum = everywhere.load(std::memory_order_relaxed) << 32;
+    unsigned x0 = column(centre.xpos - radius), x1 = column(centre.xpos + radius);
+    unsigned y0 = column(centre.ypos - radius), y1 = column(centre.ypos + radius);
+    for (unsigned y = y0; y <= y1; y += 1)
+      for (unsigned x = x0; x <= x1; x += 1)
+        sum += cells[size_t(y) * side + x].load(std::memory_order_relaxed);
+    return sum;
+  }
+};
+
+/*
+ * Class name: PerceptionCache
+ * Description:
+ *  A LifeForm's perceive() results for the current instant.  Species often
+ *  perceive several times while making one decision (e.g., a wide look
+ *  and then a narrow one, or the same radius again after an encounter
+ *  callback), and each perceive walks the QuadTree and rebuilds the list.
+ *
+ *  Radii are rounded up to a multiple of perception_bucket (reach()): the
+ *  tree is walked with the bucket's radius and the entry is stored under
+ *  it.  Any lookup at most that radius takes the neighbours within its
+ *  own radius, so radii 12 and 17 share one walk, and a narrow look after
+ *  a wide one needs none.  An entry is keyed by (reach, perceiver
+ *  position, Event::now()) and stamped with the
+ *  world's PerceptionGrid stamp of the region it covers.  Anything that
+ *  changes what a perceive would see (a position update that moves an
+ *  object, a course or speed change, a region_resize, a birth or a death)
+ *  calls LifeForm::world_changed with where it happened, which makes
+ *  stale exactly the entries whose region includes that place.  Energy
+ *  changes do not count as changes; the health of each neighbour is read
+ *  again on every hit instead (see lookup), so the perceiver paying
+ *  perceive_cost does not throw its own entries away.
+ *
+ *  perceive() still charges perceive_cost on every call, hit or miss.
+ *
+ * Recommended Usage (PERCEPTION_CACHE, in LifeForm::perceive):
+ *   lose_energy(perceive_cost(radius));
+ *   PerceptionGrid& grid = habitat().perception;
+ *   auto health = [](const LifeForm* lf) { return lf->health(); };
+ *   if (perception.lookup(grid, position(), radius, Event::now(), result, health))
+ *     return result;
+ *   double reach = PerceptionCache::reach(radius);
+ *   ...walk the tree out to 'reach', building 'wide' and 'who'...
+ *   perception.store(grid, position(), reach, Event::now(),
+ *                    std::move(wide), std::move(who));
+ *   perception.lookup(grid, position(), radius, Event::now(), result, health);
+ */
+class PerceptionCache {
+public:
+  static const unsigned ways = 2;       // buckets remembered per object
+
+private:
+  struct Entry {
+    SimTime when;
+    uint64_t stamp;
+    bool valid;
+    Point where;                // the perceiver's position
+    double reach;               // the bucket's radius
+    ObjList result;
+    std::vector<const LifeForm*> who;  // who[k] is described by result[k]
+  };
+
+  Entry entries[ways];
+  unsigned victim;              // the entry the next store replaces
+
+public:
+  PerceptionCache(void) : victim(0) {
+    for (Entry& e : entries) {
+      e.when = 0.0;
+      e.stamp = 0;
+      e.valid = false;
+      e.reach = 0.0;
+    }
+  }
+
+  /* the radius a perceive of 'radius' walks the tree with */
+  static double reach(double radius) {
+    return std::max(perception_bucket, std::ceil(radius / perception_bucket) * perception_bucket);
+  }
+
+  /*
+   * put the cached neighbours within 'radius' into 'out' (the one copy the
+   * returned list needs), with the health of every neighbour refreshed
+   * through health_of(const LifeForm*).  Returns false (and leaves 'out'
+   * alone) on a miss
+   */
+  template <typename HealthOf>
+  bool lookup(const PerceptionGrid& grid, const Point& where, double radius, SimTime now,
+              ObjList& out, HealthOf health_of) const {
+    for (const Entry& e : entries) {
+      if (!e.valid || e.when != now || e.reach < radius ||
+          e.where.xpos != where.xpos || e.where.ypos != where.ypos ||
+          e.stamp != grid.stamp(where, e.reach))
+        continue;
+      out.clear();
+      for (size_t k = 0; k < e.result.size(); k += 1) {
+        if (e.result[k].distance > radius) continue;
+        out.push_back(e.result[k]);
+        out.back().health = health_of(e.who[k]);
+      }
+      return true;
+    }
+    return false;
+  }
+
+  /* remember what a walk out to 'reach' (a bucket radius) found */
+  void store(const PerceptionGrid& grid, const Point& where, double reach, SimTime now,
+             ObjList result, std::vector<const LifeForm*> who) {
+    Entry& e = entries[victim];
+    victim = (victim + 1) % ways;
+    e.when = now;
+    e.stamp = grid.stamp(where, reach);
+    e.valid = true;
+    e.where = where;
+    e.reach = reach;
+    e.result = std::move(result);
+    e.who = std::move(who);
+  }
+
+  void clear(void) {
+    for (Entry& e : entries) {
+      e.valid = false;
+      e.result.clear();
+      e.who.clear();
+    }
+  }
+};
+
+#endif /* !(_PerceptionCache_h) */
@@ -0,0 +1,127 @@
+#if !(_Philox_h)
+#define _Philox_h 1
+
+#include <cstdint>
+
+/*
+ * Counter-based random numbers (Philox4x32-10, Salmon et al., SC'11).
+ *
+ * A counter-based generator has no state to share: the n-th number of a
+ * stream is a pure function of (key, counter).  Here the key is the
+ * world's seed and the counter is (LifeForm serial, event sequence number,
+ * block index), so
+ *   - a draw made by an object while handling an event is the same draw
+ *     whichever thread runs the event, and however many threads there are;
+ *   - draws made by different objects, or in different events, never
+ *     overlap and need no lock.
+ * Philox4x32-10 passes BigCrush.  Drawn in order from one stream it is
+ * faster than std::default_random_engine; a fresh stream per draw (one
+ * 10-round block for one number) is slower (see RngBench.cpp), which is
+ * why LifeForm::draw_uniform keeps the block it is using.
+ *
+ * Recommended Usage:
+ *   PhiloxStream rng(seed, serial, Event::running_seq());
+ *   double u = rng.uniform();            // [0, 1)
+ *   uint32_t k = rng.below(6);           // 0..5
+ * LifeForm::draw_uniform() draws the (object, event at hand) stream in
+ * order: its n-th draw is the n-th uniform() of that stream.
+ */
+class Philox4x32 {
+public:
+  struct Block { uint32_t v[4]; };
+
+  static Block generate(uint64_t key, const Block& counter) {
+    uint32_t k0 = uint32_t(key), k1 = uint32_t(key >> 32);
+    uint32_t c0 = counter.v[0], c1 = counter.v[1], c2 = counter.v[2], c3 = counter.v[3];
+    for (unsigned round = 0; round < 10; round += 1) {
+      uint64_t p0 = uint64_t(0xD2511F53u) * c0;
+      uint64_t p1 = uint64_t(0xCD9E8D57u) * c2;
+      uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+      uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+      c1 = uint32_t(p1);
+      c3 = uint32_t(p0);
+      c0 = n0;
+      c2 = n2;
+      k0 += 0x9E3779B9u;        // the Weyl sequence key schedule
+      k1 += 0xBB67AE85u;
+    }
+    Block out = { { c0, c1, c2, c3 } };
+    return out;
+  }
+};
+
+/*
+ * Class name: PhiloxStream
+ * Description:
+ *  the numbers of one (seed, serial, sequence) stream, in order.  Each
+ *  Philox call yields four 32-bit words; they are handed out before the
+ *  draw index moves on
+ */
+class PhiloxStream {
+  uint64_t key;
+  Philox4x32::Block counter;    // (draw index, serial, sequence low, sequence high)
+  Philox4x32::Block block;
+  unsigned used;                // words of 'block' already handed out
+
+  void refill(void) {
+    block = Philox4x32::generate(key, counter);
+    counter.v[0] += 1;
+    used = 0;
+  }
+
+  /* the block at the current counter (without using it) */
+  Philox4x32::Block generate_block(void) const { return Philox4x32::generate(key, counter); }
+
+public:
+  /* block 'index' of the (seed, serial, sequence) stream: uniform() draws
+     k and k + 1 of the stream come from block k / 2 */
+  static Philox4x32::Block block_at(uint64_t seed, uint64_t serial, uint64_t sequence,
+                                    uint32_t index) {
+    return PhiloxStream(seed, serial, sequence, index).generate_block();
+  }
+
+  /* [0, 1) from two words, as uniform() makes it */
+  static double to_uniform(uint32_t hi, uint32_t lo) {
+    uint64_t bits = (uint64_t(hi) << 32) | lo;
+    return double(bits >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  PhiloxStream(uint64_t seed, uint64_t serial, uint64_t sequence, uint32_t first = 0)
+    : key(seed), used(4) {
+    counter.v[0] = first;
+    counter.v[1] = uint32_t(serial) ^ uint32_t(serial >> 32);
+    counter.v[2] = uint32_t(sequence);
+    counter.v[3] = uint32_t(sequence >> 32);
+  }
+
+  uint32_t next32(void) {
+    if (used == 4) refill();
+    return block.v[used++];
+  }
+
+  uint64_t next64(void) {
+    uint64_t hi = next32();
+    return (hi << 32) | next32();
+  }
+
+  /* uniform in [0, 1), 53 bits */
+  double uniform(void) {
+    uint32_t hi = next32();
+    return to_uniform(hi, next32());
+  }
+
+  /* uniform in [0, n) (Lemire's multiply-and-reject) */
+  uint32_t below(uint32_t n) {
+    uint64_t m = uint64_t(next32()) * n;
+    if (uint32_t(m) < n) {
+      uint32_t threshold = uint32_t(-n) % n;
+      while (uint32_t(m) < threshold) m = uint64_t(next32()) * n;
+    }
+    return uint32_t(m >> 32);
+  }
+
+  /* the number of Philox blocks used so far */
+  uint32_t blocks(void) const { return counter.v[0]; }
+};
+
+#endif /* !(_Philox_h) */
@@ -0,0 +1,321 @@
+#if !(_PopulationRecorder_h)
+#define _PopulationRecorder_h 1
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Event.h"
+#include "Species.h"
+#include "SimTime.h"
+
+/* snapshots are taken this often (in simulated time) */
+const SimTime population_sample_period = 1.0;
+
+/*
+ * Population time series (POPULATION_RECORDER).
+ *
+ * The engine keeps running totals per species, updated where they change:
+ *   born     (place() and reproduce(), when an object enters the world)
+ *   died     (die())
+ *   ate      (eat(): the eater's species counts a meal)
+ *   met      (resolve_encounter: both species count an encounter)
+ *   energy   (gain_energy / lose_energy and the periodic age and
+ *             photosynthesis changes: a running sum of live energy.  With
+ *             LAZY_ENERGY the periodic changes are added when an object's
+ *             account is settled, so the sum lags a little)
+ * Every population_sample_period time units a sampling event copies the
+ * totals into a lock-free single-producer/single-consumer ring.  A
+ * background thread drains the ring into a columnar binary file, so the
+ * simulation thread never waits for the disk.  Sampling stops once the
+ * sampling event is the only thing left to run (Event::only_background),
+ * and when the recorder is closed or its World is destroyed (detach).
+ *
+ * The objects already alive when a recorder is attached are counted as
+ * present (population and energy), not as births.
+ *
+ * File layout (native byte order):
+ *   "EPLPOP1\0"
+ *   blocks:  uint32 rows (> 0), then one column at a time:
+ *            double time[rows], uint16 species[rows], uint32 population[rows],
+ *            double energy[rows], uint32 births[rows], uint32 deaths[rows],
+ *            uint32 meals[rows], uint32 encounters[rows]
+ *   footer:  uint32 0, uint32 num_names, then each name as uint32 length
+ *            and bytes (names[k] is SpeciesId k)
+ * births, deaths, meals and encounters are counts since the previous
+ * sample; population and energy are levels.
+ *
+ * Recommended Usage:
+ *   PopulationRecorder rec("run.pop");
+ *   world.attach_recorder(&rec);     // samples from now on
+ *   ...run...
+ *   rec.close();
+ *   PopulationRecorder::export_csv("run.pop", std::cout);
+ */
+class PopulationRecorder {
+public:
+  struct Row {
+    double time;
+    SpeciesId species;
+    uint32_t population;
+    double energy;
+    uint32_t births, deaths, meals, encounters;
+  };
+
+private:
+  struct Totals {
+    uint32_t population = 0;
+    double energy = 0.0;
+    uint32_t births = 0, deaths = 0, meals = 0, encounters = 0;
+  };
+
+  /* single producer (the simulation thread), single consumer (writer) */
+  class Ring {
+    std::vector<Row> rows;
+    size_t mask;
+    std::atomic<size_t> head;   // next row to write (producer)
+    std::atomic<size_t> tail;   // next row to read (consumer)
+
+  public:
+    explicit Ring(size_t capacity_log2) : rows(size_t(1) << capacity_log2),
+      mask(rows.size() - 1), head(0), tail(0) {}
+
+    /* waits (yielding) while the ring is full */
+    void push(const Row& r) {
+      size_t h = head.load(std::memory_order_relaxed);
+      while (h - tail.load(std::memory_order_acquire) == rows.size()) std::this_thread::yield();
+      rows[h & mask] = r;
+      head.store(h + 1, std::memory_order_release);
+    }
+
+    size_t pop(Row* out, size_t max) {
+      size_t t = tail.load(std::memory_order_relaxed);
+      size_t n = head.load(std::memory_order_acquire) - t;
+      if (n > max) n = max;
+      for (size_t k = 0; k < n; k += 1) out[k] = rows[(t + k) & mask];
+      tail.store(t + n, std::memory_order_release);
+      return n;
+    }
+  };
+
+  std::vector<Totals> totals;   // indexed by SpeciesId
+  Ring ring;
+  std::ofstream out;
+  std::thread writer;
+  std::atomic<bool> stopping;
+  bool open;
+  Event* sampling;              // the pending sampling event (or null)
+  PopulationRecorder** attached;  // the World's recorder slot (or null)
+
+  Totals& of(SpeciesId s) {
+    if (s >= totals.size()) totals.resize(s + 1);
+    return totals[s];
+  }
+
+  static const char* magic(void) { return "EPLPOP1"; } // 8 bytes with the NUL
+  static const size_t block_rows = 4096;
+
+  void write_block(const std::vector<Row>& block) {
+    uint32_t n = block.size();
+    out.write((const char*) &n, sizeof(n));
+    auto column = [&](auto field) {
+      for (const Row& r : block) {
+        auto v = field(r);
+        out.write((const char*) &v, sizeof(v));
+      }
+    };
+    column([](const Row& r) { return r.time; });
+    column([](const Row& r) { return r.species; });
+    column([](const Row& r) { return r.population; });
+    column([](const Row& r) { return r.energy; });
+    column([](const Row& r) { return r.births; });
+    column([](const Row& r) { return r.deaths; });
+    column([](const Row& r) { return r.meals; });
+    column([](const Row& r) { return r.encounters; });
+  }
+
+  void drain(void) {
+    std::vector<Row> block;
+    block.reserve(block_rows);
+    Row buffer[256];
+    for (;;) {
+      bool last = stopping.load(std::memory_order_acquire);
+      size_t n;
+      while ((n = ring.pop(buffer, 256)) > 0) {
+        block.insert(block.end(), buffer, buffer + n);
+        if (block.size() >= block_rows) { write_block(block); block.clear(); }
+      }
+      if (last) break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    if (!block.empty()) write_block(block);
+  }
+
+public:
+  explicit PopulationRecorder(const std::string& path, size_t ring_log2 = 16)
+    : ring(ring_log2), out(path, std::ios::binary), stopping(false), open(bool(out)),
+      sampling(nullptr), attached(nullptr) {
+    if (!open) {
+      std::cerr << "PopulationRecorder: cannot write " << path << "\n";
+      return;
+    }
+    out.write(magic(), 8);
+    writer = std::thread([this]() { drain(); });
+  }
+
+  ~PopulationRecorder(void) { close(); }
+
+  /* the engine's hooks (simulation thread only) */
+  void present(SpeciesId s, double energy) {    // alive when attached
+    Totals& t = of(s);
+    t.population += 1;
+    t.energy += energy;
+  }
+  void born(SpeciesId s, double energy) {
+    Totals& t = of(s);
+    t.population += 1;
+    t.births += 1;
+    t.energy += energy;
+  }
+  void died(SpeciesId s, double energy) {
+    Totals& t = of(s);
+    t.population -= 1;
+    t.deaths += 1;
+    t.energy -= energy;
+  }
+  void ate(SpeciesId eater) { of(eater).meals += 1; }
+  void met(SpeciesId a, SpeciesId b) { of(a).encounters += 1; of(b).encounters += 1; }
+  void energy(SpeciesId s, double delta) { of(s).energy += delta; }
+
+  /* copy the totals into the ring (the sampling event calls this) */
+  void sample(SimTime now) {
+    if (!open) return;
+    for (size_t s = 1; s < totals.size(); s += 1) {
+      Totals& t = totals[s];
+      Row r;
+      r.time = now;
+      r.species = SpeciesId(s);
+      r.population = t.population;
+      r.energy = t.energy;
+      r.births = t.births;
+      r.deaths = t.deaths;
+      r.meals = t.meals;
+      r.encounters = t.encounters;
+      ring.push(r);
+      t.births = t.deaths = t.meals = t.encounters = 0;
+    }
+  }
+
+  /* report to the World whose recorder slot this is (World::attach_recorder) */
+  void attach(PopulationRecorder** slot) {
+    detach();
+    attached = slot;
+    *slot = this;
+  }
+
+  /* stop sampling and leave the World (close() and ~World call this) */
+  void detach(void) {
+    if (sampling != nullptr) {
+      sampling->cancel();
+      Event::add_background(-1);
+      sampling = nullptr;
+    }
+    if (attached != nullptr && *attached == this) *attached = nullptr;
+    attached = nullptr;
+  }
+
+  /* sample now and then every population_sample_period, until close() or
+     until nothing but housekeeping is left to run */
+  void start_sampling(void) {
+    static EventTag sample_tag = EventProfiler::engine_tag("PopulationRecorder::sample");
+    if (!open) return;
+    sample(Event::now());
+    if (Event::only_background()) return;
+    Event::add_background(1);
+    sampling = new Event(population_sample_period, [this]() {
+      sampling = nullptr;
+      Event::add_background(-1);
+      start_sampling();
+    }, sample_tag);
+  }
+
+  /* flush everything and write the species names */
+  void close(void) {
+    detach();
+    if (!open) return;
+    open = false;
+    stopping.store(true, std::memory_order_release);
+    writer.join();
+    uint32_t zero = 0;
+    out.write((const char*) &zero, sizeof(zero));
+    uint32_t num_names = totals.size() > 0 ? totals.size() : 1;
+    out.write((const char*) &num_names, sizeof(num_names));
+    for (uint32_t k = 0; k < num_names; k += 1) {
+      const std::string& name = SpeciesRegistry::name(SpeciesId(k));
+      uint32_t len = name.size();
+      out.write((const char*) &len, sizeof(len));
+      out.write(name.data(), len);
+    }
+    out.close();
+  }
+
+  /* read a recording; returns false if it is not one */
+  static bool read(const std::string& path, std::vector<Row>& rows,
+                   std::vector<std::string>& names) {
+    std::ifstream in(path, std::ios::binary);
+    char header[8];
+    in.read(header, 8);
+    if (!in || memcmp(header, magic(), 8) != 0) return false;
+    for (;;) {
+      uint32_t n = 0;
+      in.read((char*) &n, sizeof(n));
+      if (!in) return false;
+      if (n == 0) break;
+      size_t base = rows.size();
+      rows.resize(base + n);
+      auto column = [&](auto member) {
+        for (uint32_t k = 0; k < n; k += 1)
+          in.read((char*) &(rows[base + k].*member), sizeof(rows[base + k].*member));
+      };
+      column(&Row::time);
+      column(&Row::species);
+      column(&Row::population);
+      column(&Row::energy);
+      column(&Row::births);
+      column(&Row::deaths);
+      column(&Row::meals);
+      column(&Row::encounters);
+    }
+    uint32_t num_names = 0;
+    in.read((char*) &num_names, sizeof(num_names));
+    names.resize(num_names);
+    for (std::string& name : names) {
+      uint32_t len = 0;
+      in.read((char*) &len, sizeof(len));
+      name.resize(len);
+      if (len > 0) in.read(&name[0], len);
+    }
+    return bool(in);
+  }
+
+  static bool export_csv(const std::string& path, std::ostream& csv) {
+    std::vector<Row> rows;
+    std::vector<std::string> names;
+    if (!read(path, rows, names)) return false;
+    csv << "time,species,population,energy,births,deaths,meals,encounters\n";
+    for (const Row& r : rows) {
+      csv << r.time << ',' << (r.species < names.size() ? names[r.species] : std::string("?"))
+          << ',' << r.population << ',' << r.energy << ',' << r.births << ',' << r.deaths
+          << ',' << r.meals << ',' << r.encounters << '\n';
+    }
+    return true;
+  }
+};
+
+#endif /* !(_PopulationRecorder_h) */
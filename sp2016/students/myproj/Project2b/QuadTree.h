@@ -82,7 +82,11 @@
  */
 
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <mutex>
 #include <utility>
 #include <vector>
 #include "Point.h"
@@ -99,6 +103,37 @@ class QuadTree {
   Point uleft, lright;          // not really needed, as "root" duplicates
                                 // this data, but having the copies of the 
                                 // boundary points is convenient
+  mutable std::atomic<uint64_t> num_nearby{0};  // (QUADTREE_STATS only)
+  std::recursive_mutex* shared = nullptr;   // see share()
+
+  std::unique_lock<std::recursive_mutex> guard(void) const {
+    return shared ? std::unique_lock<std::recursive_mutex>(*shared)
+                  : std::unique_lock<std::recursive_mutex>();
+  }
+
+public:
+  struct Resized {              // a resize callback, and the object it is
+    Obj obj;                    // for (kept while the callback waits)
+    std::function<void(void)> callback;
+  };
+
+  static std::vector<Resized>*& deferred(void) {
+    static thread_local std::vector<Resized>* later = nullptr;
+    return later;
+  }
+                                // while this thread points it at a list,
+                                // resize callbacks are appended to it
+                                // instead of invoked (a handler in a
+                                // parallel round must not touch objects
+                                // outside its footprint; EventBatch.h
+                                // invokes them after the round)
+
+private:
+  static void resized(Resized& r) {
+    if (!r.callback) return;
+    if (std::vector<Resized>* later = deferred()) later->push_back(std::move(r));
+    else r.callback();
+  }
 
   /* COPYING is NOT YET DEFINED NOR PERMITTED */
   QuadTree(const QuadTree<Obj>&) { assert(0); }
@@ -112,6 +147,26 @@ public:
                                 // which 'is_out_of_bounds'.
   void insert(const Obj&, const Point& pos, std::function<void(void)> = [](){});
 
+  void insert_quiet(const Obj&, const Point& pos, std::function<void(void)>);
+                                // same as insert, but the resize callback of
+                                // the object whose region shrinks is NOT
+                                // invoked (used when restoring a checkpoint,
+                                // where every object's events are restored
+                                // separately)
+
+  struct Entry {
+    Obj obj;
+    Point pos;
+    std::function<void(void)> resize;
+  };
+  void insert_bulk(std::vector<Entry>& entries);
+                                // insert many objects into an EMPTY tree at
+                                // once (loading a world snapshot).  The tree
+                                // is the one insert_quiet would build, but
+                                // each region is split once, top down, in
+                                // O(n depth) time.  No resize callbacks are
+                                // invoked, and 'entries' is reordered
+
   Obj remove(const Point&);
                                 // find the identical object 'x' in the tree
                                 // and remove it.  It is an error to attempt
@@ -142,8 +197,28 @@ public:
 
   void update_position(const Point&, const Point&) ;
   // updates position of object to new position
+
+  unsigned depth(void) const;   // the number of levels in the tree (1 for
+                                // a tree that has never been split)
+
+  unsigned size(void) const;    // the number of objects in the tree
+
+  uint64_t nearby_queries(void) const { return num_nearby.load(std::memory_order_relaxed); }
+                                // the number of nearby() calls so far (for
+                                // benchmarks; exact even when objects in a
+                                // parallel batch perceive at once).  Always
+                                // 0 unless the engine is built with
+                                // QUADTREE_STATS, which counts them
    
 
+  void share(std::recursive_mutex* lock) { shared = lock; }
+                                // while 'lock' is set, every operation holds
+                                // it (handlers running in parallel, see
+                                // EventBatch.h).  nullptr: no locking.  The
+                                // resize callbacks that are not deferred
+                                // run with it held, so it must be
+                                // recursive
+
   QuadTree(double xmin, double ymin, double xmax, double ymax) {
     uleft = Point(xmin,ymax);
     lright = Point(xmax,ymin);
@@ -156,6 +231,7 @@ public:
 template <class Obj> 
 class TreeNode {
   typedef std::pair<bool, std::function<void(void)>> Result;
+  typedef typename QuadTree<Obj>::Resized Resized;
 
   Obj obj;                      // the object that is in this region
                                 // (valid only if num_objects == 1)
@@ -178,7 +254,7 @@ class TreeNode {
   unsigned num_objects;         // the number of objects inside this region
                                 // (including objects inside my children)
 
-  void split(void) {
+  void make_children(void) {
     child = new TNPtr[4];
     double x = right() - left();
     double y = top() - bottom();
@@ -198,9 +274,13 @@ class TreeNode {
 
     /* 3th quadrant (lower right quad) */
     child[3] = new TreeNode<Obj>(uleft() + Point(halfx, -halfy), lright());
+  }
+
+  void split(void) {
+    make_children();
 
     unsigned k;                 // checked at end of "for" loop
-    std::function<void(void)> dummy = [](){};           // not used
+    Resized dummy;              // not used
     for (k = 0; k < 4; k++) {
       if (child[k]->in_bounds(obj_pos)) {
         bool tmp = child[k]->insert(obj, obj_pos, resize_event, dummy);
@@ -340,11 +420,37 @@ public:
       p.ypos > bottom();
   }
 
+  /* fill this (empty) region with the entries in [first, last), top down:
+     every region with two or more entries splits once, and the entries are
+     partitioned among the children in place.  The result is the tree that
+     inserting the entries one at a time would build */
+  typedef typename QuadTree<Obj>::Entry Entry;
+  void build(Entry* first, Entry* last) {
+    assert(is_empty());
+    num_objects = last - first;
+    if (num_objects == 0) return;
+    if (num_objects == 1) {
+      obj = first->obj;
+      obj_pos = first->pos;
+      resize_event = std::move(first->resize);
+      return;
+    }
+    make_children();
+    for (unsigned k = 0; k < 4; k++) {
+      const TreeNode<Obj>* c = child[k];
+      Entry* mid = std::partition(first, last,
+                                  [c](const Entry& e) { return c->in_bounds(e.pos); });
+      child[k]->build(first, mid);
+      first = mid;
+    }
+    assert(first == last);
+  }
+
   /* new_resize is the callback for newobj
      invoke_this is an output parameter.  It is the resize callback for
      the object who's region gets resized */
   bool insert(const Obj& newobj, const Point& pos, std::function<void(void)> new_resize,
-                std::function<void(void)>& invoke_this) {
+                Resized& invoke_this) {
     if (! in_bounds(pos)) return false;
 
     if (is_empty()) {
@@ -356,7 +462,8 @@ public:
     }
     else {
       if (child == (const TNPtr*) 0) {
-        invoke_this = resize_event;
+        invoke_this.obj = obj;
+        invoke_this.callback = resize_event;
         split();
       }
       unsigned k;               // checked at end of for loop
@@ -370,7 +477,7 @@ public:
     /* NOT REACHED */
   }
 
-  bool remove(const Point& pos, Obj& oldobj, std::function<void(void)>& invoke_this) {
+  bool remove(const Point& pos, Obj& oldobj, Resized& invoke_this) {
     if (!in_bounds(pos)) return false;
     assert(num_objects > 0);
 
@@ -401,7 +508,8 @@ public:
     /* second, clean up so that our invariants are maintained */
     if (num_objects == 1) {
       merge();
-      invoke_this = resize_event;
+      invoke_this.obj = obj;
+      invoke_this.callback = resize_event;
     }
 
     return true;
@@ -502,6 +610,14 @@ public:
       return leaf->obj_pos == x;
   }
 
+  unsigned depth(void) const {
+    if (is_leaf()) return 1;
+    unsigned deepest = 0;
+    for (int k = 0; k < 4; ++k)
+      deepest = std::max(deepest, child[k]->depth());
+    return deepest + 1;
+  }
+
   unsigned check_tree(void) const {
     if (is_leaf()) {
       assert(num_objects < 2);
@@ -528,24 +644,50 @@ QuadTree<Obj>::~QuadTree(void) {
 template <class Obj>
 void QuadTree<Obj>::insert(const Obj& obj, const Point& pos, 
                            std::function<void(void)> resize) {
-  std::function<void(void)> callback = [](){};
+  auto held = guard();
+  Resized callback;
   bool is_ok = root->insert(obj, pos, resize, callback);
   assert(is_ok);
-  callback();
+  resized(callback);
 }
          
+template <class Obj>
+void QuadTree<Obj>::insert_quiet(const Obj& obj, const Point& pos,
+                                 std::function<void(void)> resize) {
+  auto held = guard();
+  Resized callback;
+  bool is_ok = root->insert(obj, pos, resize, callback);
+  assert(is_ok);
+}
+
+template <class Obj>
+void QuadTree<Obj>::insert_bulk(std::vector<Entry>& entries) {
+  assert(root->is_empty());
+  for (const Entry& e : entries) {
+    assert(root->in_bounds(e.pos));
+    (void) e;
+  }
+  if (entries.empty()) return;
+  root->build(&entries[0], &entries[0] + entries.size());
+#ifdef DEBUG_QUADTREE
+  root->check_tree();
+#endif /* DEBUG_QUADTREE */
+}
+
 template <class Obj>
 Obj QuadTree<Obj>::remove(const Point& pos) {
-  std::function<void(void)> callback = [](){};
+  auto held = guard();
+  Resized callback;
   Obj result;
   bool is_ok = root->remove(pos, result, callback);
   assert(is_ok);
-  callback();
+  resized(callback);
   return result;
 }
 
 template <class Obj>
 Obj QuadTree<Obj>::closest(const Point& pos) const {
+  auto held = guard();
   double dist = HUGE;
   std::pair<bool,Obj> tmp = root->closest(pos, dist);
   assert(tmp.first);
@@ -554,6 +696,10 @@ Obj QuadTree<Obj>::closest(const Point& pos) const {
 
 template <class Obj>
 std::vector<Obj> QuadTree<Obj>::nearby(const Point& pos, double dist) const {
+#if QUADTREE_STATS
+  num_nearby.fetch_add(1, std::memory_order_relaxed);
+#endif /* QUADTREE_STATS */
+  auto held = guard();
   std::vector<Obj> result;
   root->find_nearby(result, pos, dist);
   return result;
@@ -567,6 +713,7 @@ bool QuadTree<Obj>::is_out_of_bounds(const Point& pos) const {
 template <class Obj>
 double QuadTree<Obj>::distance_to_edge(const Point& pos, double course) const {
   assert(root != (TreeNode<Obj>*) 0);
+  auto held = guard();
   const TreeNode<Obj>* leaf = root->find_leaf(pos).first;
   assert(leaf != (TreeNode<Obj>*) 0);
   
@@ -602,20 +749,34 @@ double QuadTree<Obj>::distance_to_edge(const Point& pos, double course) const {
 
 template <class Obj>
 bool QuadTree<Obj>::is_occupied(const Point& pos) const {
+  auto held = guard();
   return root->is_occupied(pos);
 }
 
+template <class Obj>
+unsigned QuadTree<Obj>::depth(void) const {
+  auto held = guard();
+  return root->depth();
+}
+
+template <class Obj>
+unsigned QuadTree<Obj>::size(void) const {
+  auto held = guard();
+  return root->num_objects;
+}
+
 
 template <class Obj>
 void QuadTree<Obj>::update_position(const Point& pos_old, 
                                     const Point& pos_new) {
-  
+  auto held = guard();
   std::pair<TreeNode<Obj>*, TreeNode<Obj>*> res = root->find_leaf(pos_old);
   TreeNode<Obj>* leaf = res.first;
   TreeNode<Obj>* parent = res.second;
   if (pos_old != leaf->obj_pos) {
     std::cerr << "Object Position: (" << pos_old.xpos << ", " << pos_old.ypos << ")" << std::endl;
-    std::cerr << "Leaf Position: (" << leaf->obj_pos.xpos << ", " << leaf->obj_pos.ypos << ")" << std::endl;
+    std::cerr << "Leaf Position: (" << leaf->obj_pos.xpos << ", "
+              << leaf->obj_pos.ypos << ")" << std::endl;
   }
   assert(pos_old == leaf->obj_pos);
 
@@ -635,36 +796,36 @@ void QuadTree<Obj>::update_position(const Point& pos_old,
     /* remove the object FROM THE LEAF (not from the root) to
        avoid collapsing levels in the tree */
     Obj obj;
-    std::function<void(void)> null_callback = [](){};   // must be null since removing from a leaf
+    Resized null_callback;      // must be null since removing from a leaf
     bool remove_ok = leaf->remove(pos_old, obj, null_callback);
     parent->num_objects -= 1;
     assert(remove_ok);
 
     /* inserting from the parent level and inserting at the root level
        should be the same */
-    std::function<void(void)> insert_callback = [](){};;
+    Resized insert_callback;
     bool insert_ok = parent->insert(obj, pos_new, 
                                     obj_callback, insert_callback);
     assert(insert_ok);
 
     /* tree is now stable, invoke the callback from inserting */
-    insert_callback();
+    resized(insert_callback);
   }
   else {                        // case 3: up to two callbacks
     std::function<void(void)> obj_callback = leaf->get_callbk();
 
     Obj obj;
-    std::function<void(void)> remove_callback = [](){};
+    Resized remove_callback;
     bool remove_ok = root->remove(pos_old, obj, remove_callback);
     assert(remove_ok);
 
-    std::function<void(void)> insert_callback = [](){};
+    Resized insert_callback;
     bool insert_ok = root->insert(obj, pos_new, obj_callback, insert_callback);
     assert(insert_ok);
 
     /* now the tree is stable, invoke both callbacks */
-    remove_callback();
-    insert_callback();
+    resized(remove_callback);
+    resized(insert_callback);
   }
   
 #ifdef DEBUG_QUADTREE
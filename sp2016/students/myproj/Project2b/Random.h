@@ -1,3 +1,6 @@
+#if !(_Random_h)
+#define _Random_h 1
+
 #include <random>
 
 #if defined (_MSC_VER)
@@ -6,3 +9,21 @@ extern std::default_random_engine random_generator;
 extern std::function<double(void)> drand48;
 }
 #endif
+
+#if !defined (_MSC_VER)
+#include <stdlib.h>
+
+/* the drand48 state of the calling thread's World (World::Bind points this
+   at the world's own state), or null for the process-wide drand48 state */
+inline unsigned short*& world_rng_state(void) {
+  static thread_local unsigned short* state = nullptr;
+  return state;
+}
+
+inline double world_drand48(void) {
+  unsigned short* state = world_rng_state();
+  return state ? erand48(state) : drand48();
+}
+#endif
+
+#endif /* !(_Random_h) */
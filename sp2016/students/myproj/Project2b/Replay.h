@@ -0,0 +1,264 @@
+#if !(_Replay_h)
+#define _Replay_h 1
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ObjInfo.h"
+#include "Random.h"
+
+/*
+ * Deterministic record and replay of a simulation run.
+ *
+ * While recording, the log keeps three streams:
+ *   events   the sequence number of every event that is applied, in order
+ *            (EventCompare breaks ties between equal times by sequence
+ *            number, so this is the complete order of the run)
+ *   draws    every random number drawn through replay_drand48
+ *   percepts the result of every call to LifeForm::perceive
+ *
+ * During playback the draws and percepts are read back from the log
+ * instead of being computed.  In particular perceive() does not search
+ * the QuadTree or build its ObjList (the energy cost is still charged),
+ * so a replay runs faster than the original run.  The event stream is
+ * used to check that the replay has not diverged from the recording (a
+ * different build that changes the event order is reported once).
+ *
+ * Encoding (all streams are byte strings):
+ *   events   zig-zag varint of the difference from the previous sequence
+ *            number (usually small and positive)
+ *   draws    drand48 returns k / 2^48, so a draw is stored as the varint
+ *            of 2k.  Any other value is stored as the varint 1 followed by
+ *            its 8 bytes
+ *   percepts varint count, then for each ObjInfo the varint index of its
+ *            species in a string table (a new name follows its first
+ *            index inline) and the five fields (raw bytes)
+ *
+ * Replay requires events to be applied one at a time (Event::do_next,
+ * not run_event_batch), and a run that does not depend on wall-clock
+ * time: CALLBACK_BUDGET's throttling does (see CallbackBudget.h).
+ * Compile with REPLAY_LOG to enable the hooks in Event::operator().
+ */
+class ReplayLog {
+public:
+  enum Mode {
+    REPLAY_OFF,
+    REPLAY_RECORD,
+    REPLAY_PLAYBACK
+  };
+
+private:
+  struct Stream {
+    std::string bytes;
+    size_t next = 0;            // read position during playback
+
+    void put_varint(uint64_t x) {
+      while (x >= 0x80) {
+        bytes.push_back(char(x | 0x80));
+        x >>= 7;
+      }
+      bytes.push_back(char(x));
+    }
+
+    void put_raw(const void* p, size_t n) { bytes.append((const char*) p, n); }
+
+    bool at_end(void) const { return next >= bytes.size(); }
+
+    uint64_t get_varint(void) {
+      uint64_t x = 0;
+      unsigned shift = 0;
+      while (next < bytes.size()) {
+        uint8_t b = bytes[next++];
+        x |= uint64_t(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) break;
+        shift += 7;
+      }
+      return x;
+    }
+
+    void get_raw(void* p, size_t n) {
+      if (next + n > bytes.size()) { memset(p, 0, n); next = bytes.size(); return; }
+      memcpy(p, bytes.data() + next, n);
+      next += n;
+    }
+  };
+
+  struct State {
+    Mode mode = REPLAY_OFF;
+    bool diverged = false;
+    uint64_t last_seq = 0;
+    Stream events, draws, percepts;
+    std::vector<SpeciesId> species;               // string table for percepts
+    std::unordered_map<SpeciesId, uint64_t> species_index;
+  };
+
+  static State& state(void) {
+    static thread_local State s;  // one log per thread (so per World)
+    return s;
+  }
+
+  static void diverge(const char* why) {
+    State& s = state();
+    if (!s.diverged) std::cerr << "replay: run diverged from the log (" << why << ")\n";
+    s.diverged = true;
+  }
+
+  static const char* magic(void) { return "EPLRPL2"; } // 8 bytes with the NUL
+
+public:
+  static Mode mode(void) { return state().mode; }
+  static bool diverged(void) { return state().diverged; }
+
+  static void start_recording(void) {
+    State& s = state();
+    s = State();
+    s.mode = REPLAY_RECORD;
+  }
+
+  static void stop(void) { state().mode = REPLAY_OFF; }
+
+  /* called (with REPLAY_LOG) every time an event is applied */
+  static void event(uint64_t seq) {
+    State& s = state();
+    if (s.mode == REPLAY_OFF) return;
+    int64_t delta = int64_t(seq - s.last_seq);
+    uint64_t zigzag = (uint64_t(delta) << 1) ^ uint64_t(delta >> 63);
+    s.last_seq = seq;
+    if (s.mode == REPLAY_RECORD) s.events.put_varint(zigzag);
+    else if (s.events.at_end() || s.events.get_varint() != zigzag) diverge("event order");
+  }
+
+  /* return the next random number (drawing it from 'generator' unless it
+     is being played back) */
+  template <typename Generator>
+  static double draw(Generator generator) {
+    State& s = state();
+    if (s.mode == REPLAY_PLAYBACK) {
+      if (s.draws.at_end()) { diverge("out of random draws"); return generator(); }
+      uint64_t code = s.draws.get_varint();
+      if (code != 1) return double(code >> 1) / 281474976710656.0; // 2^48
+      double x;
+      s.draws.get_raw(&x, sizeof(x));
+      return x;
+    }
+    double x = generator();
+    if (s.mode == REPLAY_RECORD) {
+      double k = x * 281474976710656.0;
+      if (k == floor(k) && k >= 0.0 && k < 281474976710656.0) {
+        s.draws.put_varint(uint64_t(k) << 1);
+      }
+      else {
+        s.draws.put_varint(1);
+        s.draws.put_raw(&x, sizeof(x));
+      }
+    }
+    return x;
+  }
+
+  /* return the result of a perceive() call.  LifeForm::perceive charges the
+     perceive_cost and then calls
+       return ReplayLog::perceive([&]() { ...search space... });  */
+  template <typename Compute>
+  static ObjList perceive(Compute compute) {
+    State& s = state();
+    ObjList result;
+    if (s.mode == REPLAY_PLAYBACK) {
+      if (s.percepts.at_end()) { diverge("out of percepts"); return compute(); }
+      uint64_t count = s.percepts.get_varint();
+      result.resize(count);
+      for (ObjInfo& info : result) {
+        uint64_t k = s.percepts.get_varint();
+        if (k == s.species.size()) {
+          uint64_t len = s.percepts.get_varint();
+          std::string name(len, '\0');
+          if (len > 0) s.percepts.get_raw(&name[0], len);
+          s.species.push_back(SpeciesRegistry::intern(name));
+        }
+        info.species = SpeciesName(k < s.species.size() ? s.species[k] : SpeciesId(0));
+        s.percepts.get_raw(&info.health, sizeof(info.health));
+        s.percepts.get_raw(&info.distance, sizeof(info.distance));
+        s.percepts.get_raw(&info.bearing, sizeof(info.bearing));
+        s.percepts.get_raw(&info.their_speed, sizeof(info.their_speed));
+        s.percepts.get_raw(&info.their_course, sizeof(info.their_course));
+      }
+      return result;
+    }
+    result = compute();
+    if (s.mode == REPLAY_RECORD) {
+      s.percepts.put_varint(result.size());
+      for (const ObjInfo& info : result) {
+        auto p = s.species_index.find(info.species.id());
+        if (p != s.species_index.end()) {
+          s.percepts.put_varint(p->second);
+        }
+        else {
+          const std::string& name = info.species.name();
+          uint64_t k = s.species.size();
+          s.species.push_back(info.species.id());
+          s.species_index[info.species.id()] = k;
+          s.percepts.put_varint(k);
+          s.percepts.put_varint(name.size());
+          s.percepts.put_raw(name.data(), name.size());
+        }
+        s.percepts.put_raw(&info.health, sizeof(info.health));
+        s.percepts.put_raw(&info.distance, sizeof(info.distance));
+        s.percepts.put_raw(&info.bearing, sizeof(info.bearing));
+        s.percepts.put_raw(&info.their_speed, sizeof(info.their_speed));
+        s.percepts.put_raw(&info.their_course, sizeof(info.their_course));
+      }
+    }
+    return result;
+  }
+
+  /* write the recorded log */
+  static bool save(std::ostream& out) {
+    State& s = state();
+    out.write(magic(), 8);
+    for (const Stream* st : { &s.events, &s.draws, &s.percepts }) {
+      uint64_t len = st->bytes.size();
+      out.write((const char*) &len, sizeof(len));
+      out.write(st->bytes.data(), len);
+    }
+    return bool(out);
+  }
+
+  /* read a log and switch to playback */
+  static bool load(std::istream& in) {
+    State& s = state();
+    s = State();
+    char header[8];
+    in.read(header, 8);
+    if (!in || memcmp(header, magic(), 8) != 0) {
+      std::cerr << "replay: not a replay log\n";
+      return false;
+    }
+    for (Stream* st : { &s.events, &s.draws, &s.percepts }) {
+      uint64_t len = 0;
+      in.read((char*) &len, sizeof(len));
+      st->bytes.resize(in ? len : 0);
+      if (len > 0 && in) in.read(&st->bytes[0], len);
+    }
+    if (!in) return false;
+    s.mode = REPLAY_PLAYBACK;
+    return true;
+  }
+};
+
+/* every random draw in the engine (and in species that want reproducible
+   runs) should go through replay_drand48 instead of drand48 */
+inline double replay_drand48(void) {
+#if defined (_MSC_VER)
+  return ReplayLog::draw([]() { return epl::drand48(); });
+#else
+  return ReplayLog::draw([]() { return world_drand48(); });
+#endif
+}
+
+#endif /* !(_Replay_h) */
@@ -0,0 +1,347 @@
+/*
+ * ScalingBench.cpp
+ *
+ * How the engine scales.  Every combination of
+ *
+ *   population   initial number of objects        (-n, default 1k 10k 100k 1M)
+ *   density      objects per unit area            (-d, default 0.004 0.04 0.4)
+ *   mix          algae: Algae only                (-m, default all three)
+ *                predators: Craig and wf2796
+ *                mixed: 80% Algae, 10% each predator
+ *   speeds       still: as the species start      (-v, default all three)
+ *                uniform: each object's speed uniform in [0, max_speed)
+ *                fast: every object at max_speed
+ *
+ * is one point.  Each point is a fresh World (in a child process, so that
+ * peak memory is its own).  The space is always grid_max x grid_max (the
+ * engine assumes it), so the density is set by where the objects start:
+ * in a side x side square at the origin, side = sqrt(population / density)
+ * capped at grid_max.  They spread over the rest of the space as they
+ * move.  The world runs for -t simulated time units (default 20), and one
+ * CSV line is printed per point:
+ *
+ *   population,density,side,mix,speeds,setup_s,events,wall_s,events_per_s,
+ *   nearby,nearby_per_s,avg_depth,max_depth,allocs_per_event,peak_rss_kb,final
+ *
+ *   density       the density placed: the one asked for, unless the side
+ *                 was capped at grid_max
+ *   nearby        QuadTree::nearby calls during the run (perceive, encounter
+ *                 checks, ...).  Counted only when the engine is built with
+ *                 QUADTREE_STATS; 0 otherwise
+ *   avg_depth     QuadTree depth, averaged over samples taken every
+ *                 simulated time unit
+ *   allocs_per_event  operator new calls during the run, per event
+ *
+ * After the table, each (density, mix, speeds) series is checked for
+ * super-linear growth: the cost per event should grow no faster than the
+ * log of the population (the tree and the queue).  The slope of log(wall
+ * per event) over log(population) between successive populations is
+ * written to stderr, marked "SUPER-LINEAR" when above 0.25 (log n growth
+ * stays well below that over a decade).
+ *
+ * The speeds apply to the initial state; species that steer change them
+ * afterwards.
+ *
+ * With -f (in a build with MEAN_FIELD_ALGAE), every point folds the algae
+ * far from the other objects into the mean field once populated (see
+ * MeanFieldAlgae.h).  The final population includes the folded algae.
+ * Each point is also run without folding (same seed), and the speedup is
+ * written to stderr after the table, one line per point:
+ *
+ *   mean field <mix>/<speeds> density <d>, <n> objects: <events unfolded>
+ *     -> <events folded> events, wall <s> -> <s> s (x<wall unfolded / folded>)
+ *
+ * Build (with the rest of the engine, minus the FLTK main, all of it with
+ * QUADTREE_STATS for the nearby columns):
+ *   g++ -std=c++14 -O2 -pthread -DNO_WINDOW=1 -DQUADTREE_STATS=1 \
+ *       ScalingBench.cpp <engine and species .cpp files>
+ *
+ * Usage:
+ *   ScalingBench [-n N ...] [-d density ...] [-m mix ...] [-v speeds ...]
+ *                [-t time] [-s seed] [-f]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+#ifdef _MSC_VER
+# include <windows.h>
+# include <psapi.h>
+#else
+# include <sys/resource.h>
+# include <sys/wait.h>
+# include <unistd.h>
+#endif
+
+#include "World.h"
+
+namespace {
+
+std::atomic<uint64_t> allocations(0);
+
+} // namespace
+
+/* count every allocation (relaxed: only the totals matter) */
+void* operator new(size_t bytes) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = malloc(bytes ? bytes : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+class ScalingBench {
+public:
+  struct Case {
+    unsigned population;
+    double density;
+    unsigned mix;               // index into mix_names
+    unsigned speeds;            // index into speed_names
+  };
+
+  struct Result {               // (plain data: sent back through a pipe)
+    double side;                // of the square the objects start in
+    double density;             // placed there
+    double setup;
+    uint64_t events;
+    double wall;
+    uint64_t nearby;
+    double avg_depth;
+    unsigned max_depth;
+    double allocs_per_event;
+    long peak_rss;
+    uint64_t survivors;
+    bool ok;
+  };
+
+  static const char* const mix_names[3];
+  static const char* const speed_names[3];
+
+  static std::vector<std::pair<std::string, unsigned>> mix_of(unsigned mix, unsigned n) {
+    switch (mix) {
+    case 0:  return { { "Algae", n } };
+    case 1:  return { { "Craig", n - n / 2 }, { "wf2796", n / 2 } };
+    default: return { { "Algae", n - 2 * (n / 10) }, { "Craig", n / 10 }, { "wf2796", n / 10 } };
+    }
+  }
+
+  static long peak_rss(void) {
+#ifdef _MSC_VER
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return long(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;     // KB on Linux
+#endif
+  }
+
+  static Result run(const Case& p, double time_limit, long seed, bool fold) {
+    Result r;
+    memset(&r, 0, sizeof(r));
+    r.side = std::min(std::sqrt(p.population / p.density), double(grid_max));
+    r.density = p.population / (r.side * r.side);
+    World world(seed);
+    World::Bind bind(&world);
+
+    auto setup = std::chrono::steady_clock::now();
+    world.populate(mix_of(p.mix, p.population), r.side);
+    if (p.speeds > 0) {
+      for (LifeForm* lf : LifeForm::all_life()) {
+        if (!lf->is_alive) continue;
+        lf->set_course(world_drand48() * 2.0 * M_PI);
+        if (lf->is_alive) lf->set_speed(p.speeds == 1 ? world_drand48() * EngineParams::max_speed()
+                                              : EngineParams::max_speed());
+      }
+    }
+#if MEAN_FIELD_ALGAE
+    if (fold) world.fold_distant_algae();
+#else
+    (void) fold;
+#endif /* MEAN_FIELD_ALGAE */
+    auto start = std::chrono::steady_clock::now();
+    r.setup = std::chrono::duration<double>(start - setup).count();
+
+    /* run a simulated time unit at a time, sampling the tree in between */
+    uint64_t nearby_before = LifeForm::space().nearby_queries();
+    uint64_t allocs_before = allocations.load();
+    double depth_sum = 0.0;
+    unsigned samples = 0;
+    for (double t = 1.0; t <= time_limit + 1.0e-9 && Event::num_events() > 0; t += 1.0) {
+      r.events += world.run_until(t);
+      unsigned d = world.tree_depth();
+      depth_sum += d;
+      samples += 1;
+      if (d > r.max_depth) r.max_depth = d;
+    }
+    auto stop = std::chrono::steady_clock::now();
+    r.wall = std::chrono::duration<double>(stop - start).count();
+    r.nearby = LifeForm::space().nearby_queries() - nearby_before;
+    r.allocs_per_event = r.events ? double(allocations.load() - allocs_before) / r.events : 0.0;
+    r.avg_depth = samples ? depth_sum / samples : world.tree_depth();
+    r.peak_rss = peak_rss();
+    for (const auto& c : world.census()) r.survivors += c.second;
+    r.ok = true;
+    return r;
+  }
+
+  /* run the point in a child process (where there is fork) */
+  static Result isolated(const Case& p, double time_limit, long seed, bool fold) {
+#ifdef _MSC_VER
+    return run(p, time_limit, seed, fold);
+#else
+    int fds[2];
+    if (pipe(fds) != 0) return run(p, time_limit, seed, fold);
+    pid_t child = fork();
+    if (child == 0) {
+      close(fds[0]);
+      Result r = run(p, time_limit, seed, fold);
+      ssize_t written = write(fds[1], &r, sizeof(r));
+      _exit(written == ssize_t(sizeof(r)) ? 0 : 1);
+    }
+    close(fds[1]);
+    Result r;
+    memset(&r, 0, sizeof(r));
+    if (read(fds[0], &r, sizeof(r)) != ssize_t(sizeof(r))) r.ok = false;
+    close(fds[0]);
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) r.ok = false;
+    return r;
+#endif
+  }
+
+  static void print_header(void) {
+    printf("population,density,side,mix,speeds,setup_s,events,wall_s,events_per_s,"
+           "nearby,nearby_per_s,avg_depth,max_depth,allocs_per_event,peak_rss_kb,final\n");
+  }
+
+  static void print(const Case& p, const Result& r) {
+    printf("%u,%g,%.1f,%s,%s,%.3f,%llu,%.3f,%.0f,%llu,%.0f,%.2f,%u,%.3f,%ld,%llu\n",
+           p.population, r.density, r.side, mix_names[p.mix], speed_names[p.speeds],
+           r.setup, (unsigned long long) r.events, r.wall,
+           r.wall > 0.0 ? r.events / r.wall : 0.0,
+           (unsigned long long) r.nearby, r.wall > 0.0 ? r.nearby / r.wall : 0.0,
+           r.avg_depth, r.max_depth, r.allocs_per_event, r.peak_rss,
+           (unsigned long long) r.survivors);
+    fflush(stdout);
+  }
+
+  /* what folding the distant algae saved at each point (-f) */
+  static void compare_fold(const std::vector<Case>& points, const std::vector<Result>& unfolded,
+                           const std::vector<Result>& folded) {
+    for (size_t k = 0; k < points.size(); k += 1) {
+      const Case& p = points[k];
+      const Result& a = unfolded[k];
+      const Result& b = folded[k];
+      if (!a.ok || !b.ok) continue;
+      fprintf(stderr, "mean field %s/%s density %g, %u objects: %llu -> %llu events, "
+              "wall %.3f -> %.3f s (x%.2f)\n", mix_names[p.mix], speed_names[p.speeds],
+              p.density, p.population, (unsigned long long) a.events,
+              (unsigned long long) b.events, a.wall, b.wall, b.wall > 0.0 ? a.wall / b.wall : 0.0);
+    }
+  }
+
+  /* the growth of the cost per event along each series of populations */
+  static void check_scaling(const std::vector<Case>& points, const std::vector<Result>& results) {
+    for (size_t k = 1; k < points.size(); k += 1) {
+      const Case& a = points[k - 1];
+      const Case& b = points[k];
+      if (a.density != b.density || a.mix != b.mix || a.speeds != b.speeds) continue;
+      const Result& ra = results[k - 1];
+      const Result& rb = results[k];
+      if (!ra.ok || !rb.ok || ra.events == 0 || rb.events == 0 || a.population == b.population)
+        continue;
+      double slope = std::log((rb.wall / rb.events) / (ra.wall / ra.events)) /
+                     std::log(double(b.population) / a.population);
+      fprintf(stderr, "scaling %s/%s density %g: %u -> %u objects, cost per event ~ n^%.2f%s\n",
+              mix_names[a.mix], speed_names[a.speeds], a.density, a.population, b.population,
+              slope, slope > 0.25 ? "  SUPER-LINEAR" : "");
+    }
+  }
+};
+
+const char* const ScalingBench::mix_names[3] = { "algae", "predators", "mixed" };
+const char* const ScalingBench::speed_names[3] = { "still", "uniform", "fast" };
+
+namespace {
+
+int index_of(const char* const names[3], const std::string& name) {
+  for (int k = 0; k < 3; k += 1)
+    if (name == names[k]) return k;
+  return -1;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  std::vector<unsigned> populations;
+  std::vector<double> densities;
+  std::vector<unsigned> mixes, speeds;
+  double time_limit = 20.0;
+  long seed = 42;
+  bool fold = false;
+
+  /* each list option takes the arguments up to the next option */
+  char list = 0;
+  for (int k = 1; k < argc; k += 1) {
+    std::string arg = argv[k];
+    bool ok = true;
+    if (arg == "-n" || arg == "-d" || arg == "-m" || arg == "-v") list = arg[1];
+    else if (arg == "-t" && k + 1 < argc) { time_limit = strtod(argv[++k], nullptr); list = 0; }
+    else if (arg == "-s" && k + 1 < argc) { seed = strtol(argv[++k], nullptr, 10); list = 0; }
+    else if (arg == "-f") { fold = true; list = 0; }
+    else if (list == 'n') populations.push_back(strtoul(arg.c_str(), nullptr, 10));
+    else if (list == 'd') densities.push_back(strtod(arg.c_str(), nullptr));
+    else if (list == 'm' && index_of(ScalingBench::mix_names, arg) >= 0)
+      mixes.push_back(index_of(ScalingBench::mix_names, arg));
+    else if (list == 'v' && index_of(ScalingBench::speed_names, arg) >= 0)
+      speeds.push_back(index_of(ScalingBench::speed_names, arg));
+    else ok = false;
+    if (!ok) {
+      fprintf(stderr, "usage: %s [-n N ...] [-d density ...] [-m algae|predators|mixed ...]"
+              " [-v still|uniform|fast ...] [-t time] [-s seed] [-f]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (populations.empty()) populations = { 1000, 10000, 100000, 1000000 };
+  if (densities.empty()) densities = { 0.004, 0.04, 0.4 };
+  if (mixes.empty()) mixes = { 0, 1, 2 };
+  if (speeds.empty()) speeds = { 0, 1, 2 };
+#if !MEAN_FIELD_ALGAE
+  if (fold) {
+    fprintf(stderr, "ScalingBench: -f needs a build with MEAN_FIELD_ALGAE (ignored)\n");
+    fold = false;
+  }
+#endif /* !MEAN_FIELD_ALGAE */
+
+  /* populations vary fastest, so that each series is contiguous */
+  std::vector<ScalingBench::Case> points;
+  for (double d : densities)
+    for (unsigned m : mixes)
+      for (unsigned v : speeds)
+        for (unsigned n : populations)
+          points.push_back(ScalingBench::Case{ n, d, m, v });
+
+  ScalingBench::print_header();
+  std::vector<ScalingBench::Result> results, unfolded;
+  for (const ScalingBench::Case& p : points) {
+    if (fold) unfolded.push_back(ScalingBench::isolated(p, time_limit, seed, false));
+    results.push_back(ScalingBench::isolated(p, time_limit, seed, fold));
+    if (results.back().ok) ScalingBench::print(p, results.back());
+    else fprintf(stderr, "ScalingBench: the point %u/%g/%s/%s failed\n", p.population, p.density,
+                 ScalingBench::mix_names[p.mix], ScalingBench::speed_names[p.speeds]);
+  }
+  ScalingBench::check_scaling(points, results);
+  if (fold) ScalingBench::compare_fold(points, unfolded, results);
+  return 0;
+}
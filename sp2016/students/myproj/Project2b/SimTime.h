@@ -1,7 +1,135 @@
 #if !(_Time_h)
 #define _Time_h 1
 
-typedef double SimTime;
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
 
-#endif /* !(_Time_h) */
+/*
+ * Class name: BasicSimTime
+ * Description:
+ *  A point in (or a span of) simulated time.  The representation is chosen
+ *  when the simulator is compiled:
+ *    default            a double holding time units
+ *    FIXED_POINT_TIME   a 64-bit integer holding ticks, with ticks_per_unit
+ *                       ticks per time unit
+ *
+ *  With fixed point time, comparing two times (which is what the event
+ *  queue does all day) is an integer compare, times that print the same
+ *  are the same, and adding min_delta_time is exact.  The tick is 2^-20
+ *  time units (about 1e-6), which leaves room for 8.7e12 time units.
+ *
+ *  SimTime converts implicitly to and from double, so code that treats it
+ *  as a number (e.g., double age = Event::now() - birth_time) still works.
+ *  Arithmetic and comparisons with SimTime operands (or with a SimTime and
+ *  a plain number) are done in the SimTime representation.
+ */
+template <typename Rep>
+class BasicSimTime {
+  static_assert(std::is_same<Rep, double>::value || std::is_same<Rep, int64_t>::value,
+                "SimTime is either double or 64-bit ticks");
+  Rep rep;
+
+  template <typename N>
+  using if_number = typename std::enable_if<std::is_arithmetic<N>::value, int>::type;
+
+public:
+  static constexpr bool is_fixed_point = std::is_integral<Rep>::value;
+  static constexpr int64_t ticks_per_unit = is_fixed_point ? (int64_t(1) << 20) : 0;
+
+  /* constexpr, so that namespace-scope SimTime constants (Params.h's
+     digestion_time, mean_field_period, ...) are initialized statically */
+  static constexpr Rep from_double(double units) {
+    if (!is_fixed_point) return Rep(units);
+    double ticks = units * double(int64_t(1) << 20);
+    if (ticks >= 9.0e18) return Rep(std::numeric_limits<int64_t>::max());
+    if (ticks <= -9.0e18) return Rep(std::numeric_limits<int64_t>::min());
+    int64_t whole = int64_t(ticks);       // rounded half away from zero, as
+    double part = ticks - double(whole);  // llround does (which is not
+    if (part >= 0.5) whole += 1;          // constexpr)
+    else if (part <= -0.5) whole -= 1;
+    return Rep(whole);
+  }
+
+  static double to_double(Rep r) {
+    return is_fixed_point ? double(r) / double(int64_t(1) << 20) : double(r);
+  }
+
+  constexpr BasicSimTime(void) : rep(0) {}
+  constexpr BasicSimTime(double units) : rep(from_double(units)) {}
+
+  static BasicSimTime from_rep(Rep r) { BasicSimTime t; t.rep = r; return t; }
+  static BasicSimTime max(void) {
+    return from_rep(is_fixed_point ? Rep(std::numeric_limits<int64_t>::max())
+                                   : Rep(std::numeric_limits<double>::max()));
+  }
 
+  constexpr Rep raw(void) const { return rep; }  // ticks (or time units for double)
+  double units(void) const { return to_double(rep); }
+  operator double(void) const { return units(); }
+
+  BasicSimTime& operator+=(BasicSimTime d) { rep += d.rep; return *this; }
+  BasicSimTime& operator-=(BasicSimTime d) { rep -= d.rep; return *this; }
+
+  friend BasicSimTime operator+(BasicSimTime a, BasicSimTime b) { return from_rep(a.rep + b.rep); }
+  friend BasicSimTime operator-(BasicSimTime a, BasicSimTime b) { return from_rep(a.rep - b.rep); }
+  friend bool operator<(BasicSimTime a, BasicSimTime b) { return a.rep < b.rep; }
+  friend bool operator>(BasicSimTime a, BasicSimTime b) { return a.rep > b.rep; }
+  friend bool operator<=(BasicSimTime a, BasicSimTime b) { return a.rep <= b.rep; }
+  friend bool operator>=(BasicSimTime a, BasicSimTime b) { return a.rep >= b.rep; }
+  friend bool operator==(BasicSimTime a, BasicSimTime b) { return a.rep == b.rep; }
+  friend bool operator!=(BasicSimTime a, BasicSimTime b) { return a.rep != b.rep; }
+
+  /* mixed SimTime / number operations (the templates are exact matches,
+     so they are preferred to converting the SimTime to double) */
+  template <typename N, if_number<N> = 0>
+  friend BasicSimTime operator+(BasicSimTime a, N b) { return a + BasicSimTime(double(b)); }
+  template <typename N, if_number<N> = 0>
+  friend BasicSimTime operator+(N a, BasicSimTime b) { return BasicSimTime(double(a)) + b; }
+  template <typename N, if_number<N> = 0>
+  friend BasicSimTime operator-(BasicSimTime a, N b) { return a - BasicSimTime(double(b)); }
+  template <typename N, if_number<N> = 0>
+  friend BasicSimTime operator-(N a, BasicSimTime b) { return BasicSimTime(double(a)) - b; }
+  template <typename N, if_number<N> = 0>
+  friend double operator*(BasicSimTime a, N b) { return a.units() * double(b); }
+  template <typename N, if_number<N> = 0>
+  friend double operator*(N a, BasicSimTime b) { return double(a) * b.units(); }
+  template <typename N, if_number<N> = 0>
+  friend double operator/(BasicSimTime a, N b) { return a.units() / double(b); }
+  template <typename N, if_number<N> = 0>
+  friend bool operator<(BasicSimTime a, N b) { return a < BasicSimTime(double(b)); }
+  template <typename N, if_number<N> = 0>
+  friend bool operator<(N a, BasicSimTime b) { return BasicSimTime(double(a)) < b; }
+  template <typename N, if_number<N> = 0>
+  friend bool operator>(BasicSimTime a, N b) { return a > BasicSimTime(double(b)); }
+  template <typename N, if_number<N> = 0>
+  friend bool operator>(N a, BasicSimTime b) { return BasicSimTime(double(a)) > b; }
+  template <typename N, if_number<N> = 0>
+  friend bool operator<=(BasicSimTime a, N b) { return a <= BasicSimTime(double(b)); }
+  template <typename N, if_number<N> = 0>
+  friend bool operator<=(N a, BasicSimTime b) { return BasicSimTime(double(a)) <= b; }
+  template <typename N, if_number<N> = 0>
+  friend bool operator>=(BasicSimTime a, N b) { return a >= BasicSimTime(double(b)); }
+  template <typename N, if_number<N> = 0>
+  friend bool operator>=(N a, BasicSimTime b) { return BasicSimTime(double(a)) >= b; }
+  template <typename N, if_number<N> = 0>
+  friend bool operator==(BasicSimTime a, N b) { return a == BasicSimTime(double(b)); }
+  template <typename N, if_number<N> = 0>
+  friend bool operator==(N a, BasicSimTime b) { return BasicSimTime(double(a)) == b; }
+  template <typename N, if_number<N> = 0>
+  friend bool operator!=(BasicSimTime a, N b) { return a != BasicSimTime(double(b)); }
+  template <typename N, if_number<N> = 0>
+  friend bool operator!=(N a, BasicSimTime b) { return BasicSimTime(double(a)) != b; }
+};
+
+template <typename Rep> constexpr bool BasicSimTime<Rep>::is_fixed_point;
+template <typename Rep> constexpr int64_t BasicSimTime<Rep>::ticks_per_unit;
+
+#if FIXED_POINT_TIME
+typedef BasicSimTime<int64_t> SimTime;
+#else
+typedef BasicSimTime<double> SimTime;
+#endif /* FIXED_POINT_TIME */
+
+#endif /* !(_Time_h) */
@@ -1,17 +1,26 @@
 // SmartPointer.h
+#include <atomic>
 #include <cstdint>
 #include <utility>
 #include <type_traits>
 
+/* the count is atomic: handlers running in parallel (EventBatch.h)
+   copy SmartPointers to shared objects, e.g. in QuadTree::nearby.  A
+   copy of an object is referred to by nothing yet */
 class ControlBlock {
 public:
-	uint32_t ref_count = 0;
+	std::atomic<uint32_t> ref_count{0};
+
+	ControlBlock(void) {}
+	ControlBlock(const ControlBlock&) {}
+	ControlBlock& operator=(const ControlBlock&) { return *this; }
 };
 
 
 template <typename T>
 class SmartPointer {
-	static_assert(std::is_base_of<ControlBlock, T>::value, "You must use ControlBlock as a base class");
+	static_assert(std::is_base_of<ControlBlock, T>::value,
+		"You must use ControlBlock as a base class");
 private:
 
 public:
@@ -38,13 +47,13 @@ public:
 		}
 
 		ptr = dynamic_cast<T*>(rhs.ptr);
-		ptr->ControlBlock::ref_count += 1;
+		ptr->ControlBlock::ref_count.fetch_add(1, std::memory_order_relaxed);
 	}
 
 	SmartPointer(T* obj = nullptr) {
 		ptr = obj;
 		if (obj) {
-			ptr->ControlBlock::ref_count += 1;
+			ptr->ControlBlock::ref_count.fetch_add(1, std::memory_order_relaxed);
 		}
 	}
 
@@ -60,14 +69,13 @@ private:
 	void copy(const SmartPointer<T>& rhs) {
 		this->ptr = rhs.ptr;
 		if (ptr) {
-			ptr->ControlBlock::ref_count += 1;
+			ptr->ControlBlock::ref_count.fetch_add(1, std::memory_order_relaxed);
 		}
 	}
 
 	void destroy(void) {
 		if (ptr) {
-			ptr->ControlBlock::ref_count -= 1;
-			if (ptr->ControlBlock::ref_count == 0) {
+			if (ptr->ControlBlock::ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
 				delete ptr;
 			}
 		}
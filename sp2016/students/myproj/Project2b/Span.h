@@ -0,0 +1,60 @@
+#if !(_Span_h)
+#define _Span_h 1
+
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Class name: Span
+ * Description:
+ *  A pointer and a length: a view of consecutive T's that it does not own
+ *  (std::span for C++14).  Span<const T> is made from a Span<T>, and
+ *  either from a std::vector.
+ *
+ * Recommended Usage:
+ *  void encounter_batch(Span<const ObjInfo> them, Span<Action> out);
+ *  for (size_t k = 0; k < them.size(); k += 1) out[k] = ...them[k]...;
+ */
+template <typename T>
+class Span {
+  T* first;
+  size_t count;
+
+public:
+  Span(void) : first(nullptr), count(0) {}
+  Span(T* first, size_t count) : first(first), count(count) {}
+
+  template <typename U, typename A,
+            typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+  Span(std::vector<U, A>& v) : first(v.data()), count(v.size()) {}
+
+  template <typename U, typename A,
+            typename = typename std::enable_if<std::is_convertible<const U*, T*>::value>::type>
+  Span(const std::vector<U, A>& v) : first(v.data()), count(v.size()) {}
+
+  template <typename U,
+            typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+  Span(const Span<U>& s) : first(s.data()), count(s.size()) {}
+
+  T* data(void) const { return first; }
+  size_t size(void) const { return count; }
+  bool empty(void) const { return count == 0; }
+
+  T& operator[](size_t k) const {
+    assert(k < count);
+    return first[k];
+  }
+
+  T* begin(void) const { return first; }
+  T* end(void) const { return first + count; }
+
+  /* the 'n' elements starting at 'offset' */
+  Span subspan(size_t offset, size_t n) const {
+    assert(offset + n <= count);
+    return Span(first + offset, n);
+  }
+};
+
+#endif /* !(_Span_h) */
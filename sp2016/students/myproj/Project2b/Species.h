@@ -0,0 +1,123 @@
+#if !(_Species_h)
+#define _Species_h 1
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Interned species names.
+ *
+ * Every species name is registered once (LifeForm::add_creator interns the
+ * name it is registered under, so the ids follow registration order) and
+ * is from then on represented by a 16-bit SpeciesId.  Id 0 is the empty
+ * name ("no species").  Names that were never registered (e.g., a species
+ * created directly by a test program) are interned the first time
+ * LifeForm::species_id() sees them.
+ *
+ * Interning takes a lock; looking a name up does not (the table never
+ * reallocates, so a name's storage stays put once it is interned).
+ */
+typedef uint16_t SpeciesId;
+
+class SpeciesRegistry {
+  static const size_t capacity = 4096;
+
+  struct Table {
+    std::mutex lock;
+    std::vector<std::string> names;
+    std::unordered_map<std::string, SpeciesId> ids;
+    Table(void) {
+      names.reserve(capacity);
+      names.push_back(std::string());
+      ids[std::string()] = 0;
+    }
+  };
+
+  static Table& table(void) {
+    static Table t;
+    return t;
+  }
+
+public:
+  static SpeciesId intern(const std::string& name) {
+    Table& t = table();
+    std::lock_guard<std::mutex> guard(t.lock);
+    auto p = t.ids.find(name);
+    if (p != t.ids.end()) return p->second;
+    if (t.names.size() == capacity) {
+      std::cerr << "SpeciesRegistry: too many species (" << name << ")\n";
+      return 0;
+    }
+    SpeciesId id = t.names.size();
+    t.names.push_back(name);
+    t.ids[name] = id;
+    return id;
+  }
+
+  /* 0 if 'name' was never interned */
+  static SpeciesId find(const std::string& name) {
+    Table& t = table();
+    std::lock_guard<std::mutex> guard(t.lock);
+    auto p = t.ids.find(name);
+    return p == t.ids.end() ? 0 : p->second;
+  }
+
+  static const std::string& name(SpeciesId id) { return table().names[id]; }
+};
+
+/*
+ * Class name: SpeciesName
+ * Description:
+ *  The species field of an ObjInfo.  It holds just the SpeciesId (so an
+ *  ObjInfo is trivially copyable and building one allocates nothing), but
+ *  it reads like the std::string it replaces:
+ *
+ *    if (info.species == "Algae") ...
+ *    std::string s = info.species;
+ *    std::cout << info.species;
+ *
+ *  Comparing two SpeciesNames compares ids, without touching the names.
+ */
+class SpeciesName {
+  SpeciesId ident;
+
+public:
+  SpeciesName(void) : ident(0) {}
+  explicit SpeciesName(SpeciesId id) : ident(id) {}
+  SpeciesName(const std::string& name) : ident(SpeciesRegistry::intern(name)) {}
+  SpeciesName(const char* name) : ident(SpeciesRegistry::intern(name)) {}
+
+  SpeciesId id(void) const { return ident; }
+  const std::string& name(void) const { return SpeciesRegistry::name(ident); }
+  operator const std::string&(void) const { return name(); }
+  const char* c_str(void) const { return name().c_str(); }
+  size_t size(void) const { return name().size(); }
+  bool empty(void) const { return ident == 0; }
+
+  bool operator==(SpeciesName o) const { return ident == o.ident; }
+  bool operator!=(SpeciesName o) const { return ident != o.ident; }
+  bool operator==(const std::string& s) const { return name() == s; }
+  bool operator!=(const std::string& s) const { return name() != s; }
+  bool operator==(const char* s) const { return strcmp(c_str(), s) == 0; }
+  bool operator!=(const char* s) const { return strcmp(c_str(), s) != 0; }
+  bool operator<(SpeciesName o) const { return name() < o.name(); }
+};
+
+inline bool operator==(const std::string& s, SpeciesName n) { return n == s; }
+inline bool operator!=(const std::string& s, SpeciesName n) { return n != s; }
+inline bool operator==(const char* s, SpeciesName n) { return n == s; }
+inline bool operator!=(const char* s, SpeciesName n) { return n != s; }
+inline std::string operator+(const std::string& s, SpeciesName n) { return s + n.name(); }
+inline std::string operator+(SpeciesName n, const std::string& s) { return n.name() + s; }
+inline std::ostream& operator<<(std::ostream& out, SpeciesName n) { return out << n.name(); }
+
+/* the species of an Event's (or WakeTimer's) target (LifeForm.cpp) */
+class LifeForm;
+SpeciesId species_of_target(const LifeForm* target);
+
+#endif /* !(_Species_h) */
@@ -0,0 +1,217 @@
+#if !(_SpeciesBatch_h)
+#define _SpeciesBatch_h 1
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Event.h"
+#include "EventBatch.h"
+#include "EventProfile.h"
+#include "LifeForm.h"
+#include "ObjInfo.h"
+#include "Span.h"
+#include "World.h"
+
+/*
+ * Batched species calls.
+ *
+ * LifeForm::encounter and LifeForm::decide are virtual calls made one
+ * object at a time.  A species that wants to share work between its objects
+ * (e.g., look at all of them together, or vectorize its scoring) overrides
+ * encounter_batch and decide_batch instead.  SpeciesBatch collects the calls
+ * that come up close together, groups them by species (SpeciesId), and
+ * makes one batch call per group, on the group's first object.  Species
+ * that do not override the batch calls get the per-object defaults, so
+ * nothing changes for them.  The pending decision requests belong to the
+ * Habitat (made on first use), so each World has its own.
+ *
+ *  - encounters: EncounterBatch (PARALLEL_ENCOUNTERS) asks both sides of
+ *    every pair in a round through SpeciesBatch::encounters.  With a
+ *    WorkPool the groups of species that are parallel_safe() run in
+ *    parallel, and a large group is split into chunks (at least
+ *    species_chunk_min calls each) so that one species can keep every
+ *    worker busy.  Each chunk is a batch call of its own, which may touch
+ *    only the objects it is given.  The other species are asked first,
+ *    one group at a time, on the calling thread.
+ *  - decisions: a species calls request_decision(radius) instead of
+ *    perceiving and steering itself.  The requests made within
+ *    decision_window of the first one are served together: each object
+ *    perceives (and pays for it) as usual, decide_batch chooses, and the
+ *    new course and speed are applied in the order the requests came in.
+ *    An object that died in the meantime is skipped.
+ *
+ * Recommended Usage (a species):
+ *   void Craig::hunt(void) { SpeciesBatch::request_decision(this, 30.0); }
+ *   void Craig::decide_batch(Span<LifeForm* const> selves,
+ *                            Span<const ObjList> seen, Span<Decision> out) {...}
+ */
+
+/* decision requests made less than this long after the first pending one
+   are served together (so a decision is made at most this late) */
+const SimTime decision_window = 0.01;
+
+/* a parallel_safe species' encounters are split into batch calls of no
+   fewer than this many objects (fewer are not worth a task) */
+const size_t species_chunk_min = 64;
+
+class SpeciesBatch {
+  struct Request {
+    SmartPointer<LifeForm> who;
+    double radius;
+  };
+
+  std::vector<Request> requests;  // in the order they were made
+  bool flush_pending;
+
+  SpeciesBatch(void) : flush_pending(false) {}
+
+  static SpeciesBatch& pending(void) {
+    std::shared_ptr<SpeciesBatch>& batch = LifeForm::habitat().decisions;
+    if (!batch) batch.reset(new SpeciesBatch);
+    return *batch;
+  }
+
+  static EventTag decide_tag(void) {
+    static EventTag tag = EventProfiler::engine_tag("decide_batch");
+    return tag;
+  }
+
+public:
+  /* the indices of 'selves', grouped by species (groups in the order each
+     species first appears, indices in order within a group) */
+  static std::vector<std::vector<size_t>> by_species(Span<LifeForm* const> selves) {
+    std::vector<std::vector<size_t>> groups;
+    std::vector<std::pair<SpeciesId, size_t>> group_of;   // (species, group)
+    for (size_t k = 0; k < selves.size(); k += 1) {
+      SpeciesId s = selves[k]->species_id();
+      size_t g = 0;
+      while (g < group_of.size() && group_of[g].first != s) g += 1;
+      if (g == group_of.size()) {
+        group_of.push_back(std::make_pair(s, groups.size()));
+        groups.emplace_back();
+      }
+      groups[group_of[g].second].push_back(k);
+    }
+    return groups;
+  }
+
+  /* out[k] = selves[k]'s answer to meeting them[k], one encounter_batch call
+     per species (in parallel on 'workers' if given, in chunks) */
+  static void encounters(Span<LifeForm* const> selves, Span<const ObjInfo> them,
+                         Span<Action> out, WorkPool* workers = nullptr) {
+    std::vector<std::vector<size_t>> groups = by_species(selves);
+    struct Chunk {
+      const std::vector<size_t>* group;
+      size_t begin, end;
+    };
+    auto run_chunk = [&](const Chunk& c) {
+      size_t n = c.end - c.begin;
+      std::vector<LifeForm*> s(n);
+      std::vector<ObjInfo> t(n);
+      std::vector<Action> a(n, LIFEFORM_IGNORE);
+      for (size_t k = 0; k < n; k += 1) {
+        s[k] = selves[(*c.group)[c.begin + k]];
+        t[k] = them[(*c.group)[c.begin + k]];
+      }
+      {
+#if SPECIES_PROFILING
+        SpeciesProfiler::Scope scope(CALLBACK_ENCOUNTER, s[0]->species_id(), n);
+#endif /* SPECIES_PROFILING */
+#if CALLBACK_BUDGET
+        CallbackWatchdog::Scope budget(s.data(), s.size(), s[0]->species_id(),
+                                       Event::now(), false);
+#endif /* CALLBACK_BUDGET */
+        s[0]->encounter_batch(s, t, a);
+      }
+      for (size_t k = 0; k < n; k += 1) out[(*c.group)[c.begin + k]] = a[k];
+    };
+    std::vector<Chunk> parallel;
+    for (const auto& g : groups) {
+      if (workers == nullptr || !selves[g[0]]->parallel_safe()) {
+        run_chunk(Chunk{ &g, 0, g.size() });
+        continue;
+      }
+      size_t per = std::max(species_chunk_min, (g.size() + workers->size() - 1) / workers->size());
+      for (size_t b = 0; b < g.size(); b += per)
+        parallel.push_back(Chunk{ &g, b, std::min(g.size(), b + per) });
+    }
+    if (parallel.size() < 2) {
+      for (const Chunk& c : parallel) run_chunk(c);
+      return;
+    }
+    World* world = World::current();
+    uint64_t seq = Event::running_seq();        // (draw_uniform is keyed by it)
+    std::vector<WorkPool::Task> tasks;
+    for (const Chunk& c : parallel) {
+      tasks.push_back([&run_chunk, c, world, seq]() {
+        World::Bind bind(world);
+        Event::SeqScope running(seq);
+        run_chunk(c);
+      });
+    }
+    workers->run(tasks);
+  }
+
+  /* have 'who' perceive 'radius' and steer by its decide_batch soon */
+  static void request_decision(SmartPointer<LifeForm> who, double radius) {
+    SpeciesBatch& batch = pending();
+    batch.requests.push_back(Request{ who, radius });
+    if (!batch.flush_pending) {
+      batch.flush_pending = true;
+      new Event(decision_window, []() { flush(); }, decide_tag());
+    }
+  }
+
+  /* serve every pending decision request.  Returns the number served */
+  static unsigned flush(void) {
+    SpeciesBatch& batch = pending();
+    std::vector<Request> todo;
+    todo.swap(batch.requests);
+    batch.flush_pending = false;
+
+    std::vector<LifeForm*> selves;
+    std::vector<ObjList> seen;
+    for (Request& r : todo) {
+      if (!r.who->is_alive) continue;
+      ObjList view = r.who->perceive(r.radius);
+      if (!r.who->is_alive) continue;     // perceiving can be fatal
+      selves.push_back(&*r.who);
+      seen.push_back(std::move(view));
+    }
+
+    std::vector<Decision> chosen(selves.size());
+    for (const auto& g : by_species(selves)) {
+      std::vector<LifeForm*> s(g.size());
+      std::vector<ObjList> v(g.size());
+      std::vector<Decision> d(g.size());
+      for (size_t k = 0; k < g.size(); k += 1) {
+        s[k] = selves[g[k]];
+        v[k].swap(seen[g[k]]);
+        d[k] = Decision{ s[k]->get_course(), s[k]->get_speed() };
+      }
+      {
+#if SPECIES_PROFILING
+        SpeciesProfiler::Scope scope(CALLBACK_DECIDE, s[0]->species_id(), g.size());
+#endif /* SPECIES_PROFILING */
+#if CALLBACK_BUDGET
+        CallbackWatchdog::Scope budget(s.data(), s.size(), s[0]->species_id(), Event::now());
+#endif /* CALLBACK_BUDGET */
+        s[0]->decide_batch(s, v, d);
+      }
+      for (size_t k = 0; k < g.size(); k += 1) chosen[g[k]] = d[k];
+    }
+
+    for (size_t k = 0; k < selves.size(); k += 1) {
+      LifeForm* lf = selves[k];
+      if (!lf->is_alive) continue;
+      if (chosen[k].course != lf->get_course()) lf->set_course(chosen[k].course);
+      if (lf->is_alive && chosen[k].speed != lf->get_speed()) lf->set_speed(chosen[k].speed);
+    }
+    return selves.size();
+  }
+};
+
+#endif /* !(_SpeciesBatch_h) */
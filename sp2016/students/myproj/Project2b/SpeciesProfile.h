@@ -0,0 +1,249 @@
+#if !(_SpeciesProfile_h)
+#define _SpeciesProfile_h 1
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "CycleClock.h"
+#include "EventProfile.h"
+#include "SimTime.h"
+#include "Species.h"
+
+/*
+ * Per-species CPU accounting (SPECIES_PROFILING).
+ *
+ * The species library has many authors, and one slow hunt() or
+ * encounter() can cost more than the rest of the simulation.  With
+ * SPECIES_PROFILING the engine times every call into species code with
+ * CycleClock and charges it to (species, kind):
+ *   encounter   encounter() / encounter_batch()  (resolve_encounter,
+ *               SpeciesBatch::encounters)
+ *   decide      decide_batch()                   (SpeciesBatch::flush)
+ *   event       events and WakeTimer actions run for one of the
+ *               species' objects (those with a target), whatever their
+ *               tag: a species' hunt is often tagged EVENT_HUNT (as
+ *               Behavior's sleep() is by default), and the engine's own
+ *               per-object events are work done for that object too
+ *   construct   the species' constructor         (World::populate, place,
+ *               reproduce)
+ * Times are exclusive: an encounter() reached from inside a species' event
+ * is charged to encounter, not to both.
+ *
+ * Each thread has its own counters.  A report may be printed at any time,
+ * including while the simulation runs (sample_every), and shows the sum
+ * over all threads.  The counters are relaxed atomics, so a live report is
+ * a consistent-enough snapshot, not an exact one.  The counters are
+ * cumulative until reset() (Headless resets them at the start of each
+ * run).  sample_every stops once its own event is all that is left to
+ * run, so RUN_TILL_EVENTS_EXHAUSTED still ends.
+ *
+ * Recommended Usage:
+ *   SpeciesProfiler::report(std::cerr);                 // at the end of a run
+ *   SpeciesProfiler::sample_every(10.0, std::cerr);     // or live (Event.h)
+ */
+enum SpeciesCallback {
+  CALLBACK_ENCOUNTER,
+  CALLBACK_DECIDE,
+  CALLBACK_EVENT,
+  CALLBACK_CONSTRUCT,
+  NUM_SPECIES_CALLBACKS
+};
+
+class SpeciesProfiler {
+public:
+  struct Stats {
+    uint64_t calls = 0;
+    uint64_t ticks = 0;         // CycleClock ticks, exclusive
+    uint64_t max_ticks = 0;
+  };
+
+private:
+  struct Cell {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> ticks{0};
+    std::atomic<uint64_t> max_ticks{0};
+  };
+
+  /* one Table per thread that has called into a species */
+  struct Table {
+    std::mutex grow;            // held while 'cells' grows, and by readers
+    std::vector<std::unique_ptr<Cell[]>> cells;   // [species][kind]
+    uint64_t inner = 0;         // ticks spent in nested scopes (owner only)
+  };
+
+  struct Globals {
+    std::mutex lock;
+    std::vector<std::unique_ptr<Table>> tables;
+  };
+
+  static Globals& globals(void) {
+    static Globals g;
+    return g;
+  }
+
+  static Table& local(void) {
+    static thread_local Table* table = nullptr;
+    if (table == nullptr) {
+      Globals& g = globals();
+      std::lock_guard<std::mutex> guard(g.lock);
+      g.tables.emplace_back(new Table);
+      table = g.tables.back().get();
+    }
+    return *table;
+  }
+
+  static Cell& cell(Table& t, SpeciesId s, SpeciesCallback kind) {
+    if (s >= t.cells.size()) {
+      std::lock_guard<std::mutex> guard(t.grow);
+      while (t.cells.size() <= s) t.cells.emplace_back(new Cell[NUM_SPECIES_CALLBACKS]);
+    }
+    return t.cells[s][kind];
+  }
+
+  static void add(std::atomic<uint64_t>& a, uint64_t v) {
+    a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+  }
+
+public:
+  static void record(SpeciesId s, SpeciesCallback kind, uint64_t calls, uint64_t ticks) {
+    Cell& c = cell(local(), s, kind);
+    add(c.calls, calls);
+    add(c.ticks, ticks);
+    if (ticks > c.max_ticks.load(std::memory_order_relaxed))
+      c.max_ticks.store(ticks, std::memory_order_relaxed);
+  }
+
+  /*
+   * Scope times one call (or one batch of 'calls' calls) into species code.
+   * The species may be given after the call, e.g. for a constructor:
+   *   SpeciesProfiler::Scope scope(CALLBACK_CONSTRUCT);
+   *   SmartPointer<LifeForm> lf = create();
+   *   scope.charge(lf->species_id());
+   */
+  class Scope {
+    SpeciesId species;
+    SpeciesCallback kind;
+    uint64_t calls;
+    uint64_t start;
+    uint64_t outer_inner;
+
+  public:
+    explicit Scope(SpeciesCallback kind, SpeciesId species = 0, uint64_t calls = 1)
+      : species(species), kind(kind), calls(calls) {
+      Table& t = local();
+      outer_inner = t.inner;
+      t.inner = 0;
+      start = CycleClock::now();
+    }
+    void charge(SpeciesId s) { species = s; }
+    ~Scope(void) {
+      uint64_t elapsed = CycleClock::now() - start;
+      Table& t = local();
+      uint64_t self = elapsed > t.inner ? elapsed - t.inner : 0;
+      t.inner = outer_inner + elapsed;
+      if (species != 0) record(species, kind, calls, self);
+    }
+
+  private:
+    Scope(const Scope&) = delete;
+    void operator=(const Scope&) = delete;
+  };
+
+  static const char* kind_name(SpeciesCallback kind) {
+    static const char* names[NUM_SPECIES_CALLBACKS] = {
+      "encounter", "decide", "event", "construct"
+    };
+    return names[kind];
+  }
+
+  /* totals[species][kind], summed over all threads */
+  static std::vector<std::vector<Stats>> totals(void) {
+    std::vector<std::vector<Stats>> sum;
+    Globals& g = globals();
+    std::lock_guard<std::mutex> guard(g.lock);
+    for (auto& t : g.tables) {
+      std::lock_guard<std::mutex> grow(t->grow);
+      if (sum.size() < t->cells.size())
+        sum.resize(t->cells.size(), std::vector<Stats>(NUM_SPECIES_CALLBACKS));
+      for (size_t s = 0; s < t->cells.size(); s += 1) {
+        for (unsigned k = 0; k < NUM_SPECIES_CALLBACKS; k += 1) {
+          const Cell& c = t->cells[s][k];
+          Stats& out = sum[s][k];
+          out.calls += c.calls.load(std::memory_order_relaxed);
+          out.ticks += c.ticks.load(std::memory_order_relaxed);
+          out.max_ticks = std::max(out.max_ticks, c.max_ticks.load(std::memory_order_relaxed));
+        }
+      }
+    }
+    return sum;
+  }
+
+  /* one line per (species, kind) that was called, most expensive first */
+  static void report(std::ostream& out) {
+    std::vector<std::vector<Stats>> sum = totals();
+    struct Line { SpeciesId s; unsigned k; Stats st; };
+    std::vector<Line> lines;
+    uint64_t all = 0;
+    for (size_t s = 0; s < sum.size(); s += 1)
+      for (unsigned k = 0; k < NUM_SPECIES_CALLBACKS; k += 1)
+        if (sum[s][k].calls > 0) {
+          lines.push_back(Line{ SpeciesId(s), k, sum[s][k] });
+          all += sum[s][k].ticks;
+        }
+    std::stable_sort(lines.begin(), lines.end(),
+                     [](const Line& a, const Line& b) { return a.st.ticks > b.st.ticks; });
+
+    double us_per_tick = 1.0e6 / CycleClock::ticks_per_second();
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::left << std::setw(16) << "species" << std::setw(11) << "callback"
+        << std::right << std::setw(12) << "calls"
+        << std::setw(12) << "total ms"
+        << std::setw(10) << "mean us"
+        << std::setw(10) << "max us"
+        << std::setw(8) << "share" << "\n";
+    for (const Line& l : lines) {
+      out << std::left << std::setw(16) << SpeciesRegistry::name(l.s)
+          << std::setw(11) << kind_name(SpeciesCallback(l.k))
+          << std::right << std::setw(12) << l.st.calls
+          << std::fixed << std::setprecision(2)
+          << std::setw(12) << l.st.ticks * us_per_tick / 1.0e3
+          << std::setw(10) << l.st.ticks * us_per_tick / l.st.calls
+          << std::setw(10) << l.st.max_ticks * us_per_tick
+          << std::setw(7) << std::setprecision(1) << 100.0 * l.st.ticks / (all ? all : 1) << "%\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+  }
+
+  /* forget everything measured so far */
+  static void reset(void) {
+    Globals& g = globals();
+    std::lock_guard<std::mutex> guard(g.lock);
+    for (auto& t : g.tables) {
+      std::lock_guard<std::mutex> grow(t->grow);
+      for (auto& row : t->cells)
+        for (unsigned k = 0; k < NUM_SPECIES_CALLBACKS; k += 1) {
+          row[k].calls.store(0, std::memory_order_relaxed);
+          row[k].ticks.store(0, std::memory_order_relaxed);
+          row[k].max_ticks.store(0, std::memory_order_relaxed);
+        }
+    }
+  }
+
+  /* print a report every 'period' simulated time units, from now on,
+     while there is anything else to run (defined in Event.h, since it
+     schedules an Event) */
+  static void sample_every(SimTime period, std::ostream& out);
+};
+
+#include "Event.h"
+
+#endif /* !(_SpeciesProfile_h) */
@@ -0,0 +1,131 @@
+/*
+ * Sweep.cpp
+ *
+ * Parameter sweep over seeds and species mixes.  Every (seed, mix) pair
+ * is an independent World; the worlds are run on all cores (one World per
+ * thread at a time, see World.h) and one line is printed per run:
+ *
+ *   seed  mix  events  wall(s)  final census
+ *
+ * The output is sorted by (mix, seed), so it does not depend on which
+ * thread finished first.
+ *
+ * Build (with the rest of the engine, minus the FLTK main):
+ *   g++ -std=c++14 -O2 -pthread -DNO_WINDOW=1 Sweep.cpp <engine and species .cpp files>
+ *
+ * Usage:
+ *   Sweep [-seeds N] [-t time_limit] [-j threads] [mix ...]
+ * where a mix is a comma separated list of species=count, e.g.
+ *   Sweep -seeds 8 Algae=2000,Craig=100 Algae=2000,Craig=100,wf2796=100
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "World.h"
+
+namespace {
+
+typedef std::vector<std::pair<std::string, unsigned>> Mix;
+
+struct Run {
+  long seed;
+  size_t mix;
+  uint64_t events;
+  double wall;
+  std::map<std::string, size_t> census;
+};
+
+Mix parse_mix(const std::string& text) {
+  Mix mix;
+  std::istringstream in(text);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    size_t eq = item.find('=');
+    if (eq == std::string::npos) continue;
+    mix.push_back(std::make_pair(item.substr(0, eq),
+                                 unsigned(strtoul(item.c_str() + eq + 1, nullptr, 10))));
+  }
+  return mix;
+}
+
+std::string mix_name(const Mix& mix) {
+  std::string name;
+  for (const auto& m : mix) {
+    if (!name.empty()) name += ",";
+    name += m.first + "=" + std::to_string(m.second);
+  }
+  return name;
+}
+
+void run_one(Run& r, const Mix& mix, double time_limit) {
+  World world(r.seed);
+  World::Bind bind(&world);
+  world.populate(mix);
+  auto start = std::chrono::steady_clock::now();
+  r.events = world.run_until(time_limit);
+  auto stop = std::chrono::steady_clock::now();
+  r.wall = std::chrono::duration<double>(stop - start).count();
+  r.census = world.census();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  unsigned num_seeds = 4;
+  double time_limit = 100.0;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<Mix> mixes;
+
+  for (int k = 1; k < argc; k += 1) {
+    std::string arg = argv[k];
+    if (arg == "-seeds" && k + 1 < argc) num_seeds = strtoul(argv[++k], nullptr, 10);
+    else if (arg == "-t" && k + 1 < argc) time_limit = strtod(argv[++k], nullptr);
+    else if (arg == "-j" && k + 1 < argc) threads = std::max(1ul, strtoul(argv[++k], nullptr, 10));
+    else if (arg.find('=') != std::string::npos) mixes.push_back(parse_mix(arg));
+    else {
+      fprintf(stderr, "usage: %s [-seeds N] [-t time_limit] [-j threads] [species=count,... ...]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (mixes.empty()) {
+    /* the species in this directory, 1000 of each */
+    Mix all;
+    for (const char* name : { "Algae", "Craig", "wf2796" })
+      all.push_back(std::make_pair(std::string(name), 1000u));
+    mixes.push_back(all);
+  }
+
+  std::vector<Run> runs;
+  for (size_t m = 0; m < mixes.size(); m += 1)
+    for (unsigned s = 0; s < num_seeds; s += 1)
+      runs.push_back(Run{ long(s + 1), m, 0, 0.0, {} });
+
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < std::min<size_t>(threads, runs.size()); t += 1) {
+    workers.emplace_back([&]() {
+      for (size_t k = next++; k < runs.size(); k = next++)
+        run_one(runs[k], mixes[runs[k].mix], time_limit);
+    });
+  }
+  for (std::thread& w : workers) w.join();
+
+  printf("%6s  %-40s %12s %9s  %s\n", "seed", "mix", "events", "wall(s)", "census");
+  for (const Run& r : runs) {
+    std::string census;
+    for (const auto& c : r.census) census += c.first + "=" + std::to_string(c.second) + " ";
+    printf("%6ld  %-40s %12llu %9.3f  %s\n", r.seed, mix_name(mixes[r.mix]).c_str(),
+           (unsigned long long) r.events, r.wall, census.c_str());
+  }
+  return 0;
+}
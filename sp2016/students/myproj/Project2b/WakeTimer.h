@@ -0,0 +1,237 @@
+#if !(_WakeTimer_h)
+#define _WakeTimer_h 1
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Event.h"
+
+/*
+ * Class name: WakeTimer
+ * Description:
+ *  A per-object multiplexer for timed actions.  A LifeForm typically has
+ *  several things pending at once (the next border crossing, the next age
+ *  tick, a species' next hunt, digestion, ...).  Rather than giving each
+ *  of them its own Event in the global queue, the object keeps a short
+ *  sorted list of its pending actions, and the global queue holds a single
+ *  "wakeup" Event at the earliest deadline.  When the wakeup fires, every
+ *  action that is due runs (earliest first, ties in the order they were
+ *  scheduled) and the wakeup is re-armed for the next deadline.
+ *
+ *  Scheduling or cancelling an action only touches the global queue when
+ *  the earliest deadline moves earlier; the wakeup is then moved (not
+ *  cancelled and replaced, so no dead wakeups pile up in the queue).  If
+ *  it moves later (e.g., the earliest action was cancelled), the wakeup is
+ *  left where it is; it finds nothing due when it fires and simply
+ *  re-arms.  Most reschedules are therefore local list updates, and the
+ *  global queue holds one event per object with something pending.  (In
+ *  a batch round, see EventBatch.h, the queue cannot be touched: there an
+ *  earlier deadline cancels the wakeup and arms a new one.)
+ *
+ *  Checkpoints save the pending actions by tag and rebuild them through
+ *  action rebinders (Checkpoint::register_action).
+ *
+ * Recommended Usage:
+ *  hunt_action = timers.schedule(dt, hunt_tag, [this]() { hunt(); });
+ *  ...
+ *  timers.cancel(hunt_action);
+ *
+ *  Actions carry an EventTag, so EVENT_PROFILING still reports them per
+ *  handler.  Actions that run in the same wakeup see the same Event::now().
+ */
+class WakeTimer {
+public:
+  typedef uint32_t Handle;      // 0 is never a valid handle
+  typedef std::function<void(void)> Action;
+
+private:
+  struct Pending {
+    SimTime when;
+    uint64_t order;             // breaks ties between equal deadlines
+    Handle id;
+    EventTag tag;
+    Action what;
+  };
+
+  std::vector<Pending> pending; // sorted by (when, order)
+  const LifeForm* owner;
+  Event* wakeup;                // the one event in the global queue (or null)
+  SimTime armed_at;             // when 'wakeup' will fire
+  Handle next_id;
+  uint64_t next_order;
+  bool firing;
+  bool* destroyed;              // set while firing, so an action that kills
+                                // the owner (and this timer) stops the loop
+
+  /* COPYING is NOT PERMITTED (the wakeup event refers to this timer) */
+  WakeTimer(const WakeTimer&) = delete;
+  WakeTimer& operator=(const WakeTimer&) = delete;
+
+  static bool earlier(const Pending& a, const Pending& b) {
+    return a.when < b.when || (a.when == b.when && a.order < b.order);
+  }
+
+  void rearm(void) {
+    if (firing) return;
+    if (pending.empty()) return;       // a stale wakeup is harmless
+    SimTime next = pending.front().when;
+    if (wakeup != nullptr && armed_at <= next) return;
+    armed_at = next;
+    if (wakeup != nullptr) {
+      if (!wakeup->in_queue || Event::staged_events() == nullptr) {
+        wakeup->move_to(next);
+        return;
+      }
+      wakeup->cancel();                // (a batch round: see above)
+    }
+    wakeup = (new Event(Event::At(), next, [this]() { fire(); }, EVENT_WAKEUP))
+               ->set_target(owner);
+  }
+
+  /* Checkpoint::restore puts a rebuilt action back at its saved deadline
+     (now + delta may round) */
+  void restore_deadline(Handle id, SimTime when) {
+    for (auto p = pending.begin(); p != pending.end(); ++p) {
+      if (p->id == id) {
+        Pending moved = std::move(*p);
+        pending.erase(p);
+        moved.when = when;
+        pending.insert(std::upper_bound(pending.begin(), pending.end(), moved, earlier),
+                       std::move(moved));
+        rearm();
+        return;
+      }
+    }
+  }
+
+  friend class Checkpoint;
+  friend class WorldSnapshot;
+
+  void fire(void) {
+    wakeup = nullptr;           // Event::do_next deletes the event after this
+    bool gone = false;
+    destroyed = &gone;
+    firing = true;
+    SimTime now = Event::now();
+    while (!pending.empty() && pending.front().when <= now) {
+      Pending p = std::move(pending.front());
+      pending.erase(pending.begin());
+      {
+#if EVENT_PROFILING
+        EventProfiler::Scope scope(p.tag, now);
+#endif /* EVENT_PROFILING */
+#if SPECIES_PROFILING
+        SpeciesProfiler::Scope species_scope(CALLBACK_EVENT,
+            owner != nullptr ? species_of_target(owner) : 0);
+#endif /* SPECIES_PROFILING */
+#if CALLBACK_BUDGET
+        LifeForm* self = const_cast<LifeForm*>(owner);
+        CallbackWatchdog::Scope budget(&self, owner != nullptr,
+            owner != nullptr && EventProfiler::is_species_tag(p.tag)
+            ? species_of_target(owner) : 0, now);
+#endif /* CALLBACK_BUDGET */
+        p.what();
+      }
+      if (gone) return;
+    }
+    destroyed = nullptr;
+    firing = false;
+    rearm();
+  }
+
+public:
+  explicit WakeTimer(const LifeForm* owner = nullptr)
+    : owner(owner), wakeup(nullptr), armed_at(0.0), next_id(1), next_order(0),
+      firing(false), destroyed(nullptr) {}
+
+  ~WakeTimer(void) {
+    if (wakeup != nullptr) wakeup->cancel();
+    if (destroyed != nullptr) *destroyed = true;
+  }
+
+  /* run 'what' delta time units from now (at least min_delta_time) */
+  Handle schedule(SimTime delta, EventTag tag, Action what) {
+    if (delta < min_delta_time) delta = min_delta_time;
+#if CALLBACK_BUDGET
+    delta = CallbackWatchdog::adjust_delay(delta, tag);
+#endif /* CALLBACK_BUDGET */
+    Pending p;
+    p.when = Event::now() + delta;
+    p.order = next_order++;
+    p.id = next_id++;
+    if (next_id == 0) next_id = 1;
+    p.tag = tag;
+    p.what = std::move(what);
+    Handle id = p.id;
+    pending.insert(std::upper_bound(pending.begin(), pending.end(), p, earlier), std::move(p));
+    rearm();
+    return id;
+  }
+
+  Handle schedule(SimTime delta, Action what) {
+    return schedule(delta, EVENT_UNTAGGED, std::move(what));
+  }
+
+  /* returns false if the action already ran (or was cancelled) */
+  bool cancel(Handle id) {
+    for (auto p = pending.begin(); p != pending.end(); ++p) {
+      if (p->id == id) {
+        pending.erase(p);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /* move a pending action to 'delta' time units from now (at least
+     min_delta_time, and throttled as schedule is) */
+  bool reschedule(Handle id, SimTime delta) {
+    if (delta < min_delta_time) delta = min_delta_time;
+    for (auto p = pending.begin(); p != pending.end(); ++p) {
+      if (p->id == id) {
+        Pending moved = std::move(*p);
+        pending.erase(p);
+#if CALLBACK_BUDGET
+        delta = CallbackWatchdog::adjust_delay(delta, moved.tag);
+#endif /* CALLBACK_BUDGET */
+        moved.when = Event::now() + delta;
+        moved.order = next_order++;
+        pending.insert(std::upper_bound(pending.begin(), pending.end(), moved, earlier),
+                       std::move(moved));
+        rearm();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool is_pending(Handle id) const {
+    for (const Pending& p : pending)
+      if (p.id == id) return true;
+    return false;
+  }
+
+  void cancel_all(void) {
+    pending.clear();
+    if (wakeup != nullptr) wakeup->cancel();
+    wakeup = nullptr;
+  }
+
+  /* drop every action and the wakeup without cancelling it (its Event is
+     deleted by the caller: Checkpoint::restore) */
+  void forget(void) {
+    pending.clear();
+    wakeup = nullptr;
+  }
+
+  size_t size(void) const { return pending.size(); }
+
+  /* the earliest pending deadline (SimTime::max() if nothing is pending) */
+  SimTime next_deadline(void) const {
+    return pending.empty() ? SimTime::max() : pending.front().when;
+  }
+};
+
+#endif /* !(_WakeTimer_h) */
@@ -0,0 +1,222 @@
+#if !(_World_h)
+#define _World_h 1
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Event.h"
+#include "LifeForm.h"
+#include "QuadTree.h"
+#include "Random.h"
+
+/*
+ * Class name: World
+ * Description:
+ *  One complete simulation: its event queue and clock (EventQueueState),
+ *  its LifeForms' space, all_life list and window (LifeForm::Habitat) and
+ *  its random number state.  Nothing of a World is shared with another
+ *  World, so several can run at the same time on different threads.
+ *
+ *  Engine code reaches "the" queue and "the" space through Event::state()
+ *  and LifeForm::habitat(), which follow the World bound to the calling
+ *  thread.  A thread that never binds a World uses the default one (the
+ *  old process-wide statics, with the window), so single-world programs
+ *  do not change.
+ *
+ * Recommended Usage (one World per thread):
+ *   World w(seed);
+ *   World::Bind bind(&w);
+ *   w.populate({ { "Algae", 500 }, { "Craig", 50 } });
+ *   w.run_until(1000.0);
+ *
+ *  Random draws are per World only when they go through world_drand48 (or
+ *  replay_drand48); code that calls drand48 directly still shares the
+ *  process-wide state.  Each thread also has its own ReplayLog; each World
+ *  has its own pending EncounterBatch and the WorkPool that resolves it
+ *  (in its Habitat).  EventProfiler totals stay process-wide.
+ */
+class World {
+  std::unique_ptr<EventQueueState> events;
+  std::unique_ptr<LifeForm::Habitat> life;
+  unsigned short rng[3];        // drand48 state (see world_rng_state); the
+                                // counter-based draws use life->seed
+
+  static World*& bound(void) {
+    static thread_local World* world = nullptr;
+    return world;
+  }
+
+  World(const World&) = delete;
+  void operator=(const World&) = delete;
+
+public:
+  /*
+   * Class name: World::Bind
+   * Description:
+   *  Make a World the calling thread's World for the lifetime of the Bind
+   *  (binding nullptr leaves the thread's World alone).  Binds nest.
+   */
+  class Bind {
+    World* previous;
+    EventQueueState* previous_events;
+    LifeForm::Habitat* previous_life;
+    unsigned short* previous_rng;
+    bool active;
+
+  public:
+    explicit Bind(World* w) : active(w != nullptr) {
+      if (!active) return;
+      previous = bound();
+      previous_events = Event::bound_state();
+      previous_life = LifeForm::bound_habitat();
+      previous_rng = world_rng_state();
+      bound() = w;
+      Event::bound_state() = w->events.get();
+      LifeForm::bound_habitat() = w->life.get();
+      world_rng_state() = w->rng;
+    }
+    ~Bind(void) {
+      if (!active) return;
+      bound() = previous;
+      Event::bound_state() = previous_events;
+      LifeForm::bound_habitat() = previous_life;
+      world_rng_state() = previous_rng;
+    }
+
+  private:
+    Bind(const Bind&) = delete;
+    void operator=(const Bind&) = delete;
+  };
+
+  /* an empty world, with its random numbers seeded as srand48(seed) would.
+     Headless unless given a window.  Its space is grid_max x grid_max, as
+     the engine (LifeForm.cpp) assumes */
+  explicit World(long seed = 0, Canvas* win = nullptr)
+    : events(new EventQueueState), life(new LifeForm::Habitat(win)) {
+    rng[0] = 0x330E;
+    rng[1] = (unsigned short) (seed & 0xffff);
+    rng[2] = (unsigned short) ((seed >> 16) & 0xffff);
+    life->seed = uint64_t(seed);
+  }
+
+  /*
+   * the LifeForms go first (while their events can still be cancelled),
+   * then the events (whose handlers may hold the last reference to a
+   * LifeForm), then the space they lived in
+   */
+  ~World(void) {
+    Bind bind(this);
+#if POPULATION_RECORDER
+    if (life->recorder != nullptr) life->recorder->detach();
+#endif /* POPULATION_RECORDER */
+    std::vector<SmartPointer<LifeForm>> residents;
+    for (LifeForm* lf : life->all_life) {
+      if (lf->is_alive) residents.push_back(life->space.remove(lf->position()));
+    }
+    residents.clear();
+    events.reset();
+    life.reset();
+  }
+
+  /* the World bound to the calling thread (nullptr: the default world) */
+  static World* current(void) { return bound(); }
+
+  /* add count objects of each species at random free positions (the mix
+     is created round robin, so no species is placed entirely first),
+     within the side x side square at the origin if 'side' is given (a
+     denser start; the objects spread over the space as they move) */
+  void populate(const std::vector<std::pair<std::string, unsigned>>& mix, double side = 0.0) {
+    Bind bind(this);
+    if (side <= 0.0 || side > life->extent) side = life->extent;
+    LFCreatorTable& creators = LifeForm::istream_creators();
+    std::vector<std::pair<IstreamCreator, unsigned>> todo;
+    for (const auto& m : mix) {
+      auto c = creators.find(m.first);
+      if (c == creators.end()) {
+        std::cerr << "World: species " << m.first << " is not registered\n";
+        continue;
+      }
+      todo.push_back(std::make_pair(c->second, m.second));
+    }
+    for (bool placed = true; placed; ) {
+      placed = false;
+      for (auto& t : todo) {
+        if (t.second == 0) continue;
+        t.second -= 1;
+        placed = true;
+        Point p;
+        do {
+          p = Point(world_drand48() * side, world_drand48() * side);
+        } while (life->space.is_occupied(p));
+#if SPECIES_PROFILING
+        SpeciesProfiler::Scope scope(CALLBACK_CONSTRUCT);
+        SmartPointer<LifeForm> lf = t.first();
+        scope.charge(lf->species_id());
+#else
+        SmartPointer<LifeForm> lf = t.first();
+#endif /* SPECIES_PROFILING */
+        LifeForm::place(lf, p);
+      }
+    }
+  }
+
+  /* process events until the queue is empty or the next event is later
+     than 'limit'.  Returns the number of events processed */
+  uint64_t run_until(SimTime limit) {
+    Bind bind(this);
+    uint64_t count = 0;
+    while (Event::num_events() > 0) {
+      Event* e = Event::pop_next(limit);
+      if (e == nullptr) break;
+      events->now = e->t;
+      (*e)();
+      delete e;
+      count += 1;
+    }
+    return count;
+  }
+
+  SimTime now(void) const { return events->now; }
+
+#if POPULATION_RECORDER
+  /* report this world's population to 'rec' (which counts the objects
+     already alive as present, not born) and start sampling it */
+  void attach_recorder(PopulationRecorder* rec) {
+    Bind bind(this);
+    rec->attach(&life->recorder);
+    for (LifeForm* lf : life->all_life)
+      if (lf->is_alive) rec->present(lf->species_id(), lf->health() * start_energy);
+    rec->start_sampling();
+  }
+#endif /* POPULATION_RECORDER */
+
+#if MEAN_FIELD_ALGAE
+  /* from now on, fold the Algae that nothing else could perceive into the
+     mean field, and wake them as others approach (see MeanFieldAlgae.h) */
+  void fold_distant_algae(void) {
+    Bind bind(this);
+    life->field.start();
+  }
+#endif /* MEAN_FIELD_ALGAE */
+
+  /* the number of live objects of each species (with MEAN_FIELD_ALGAE,
+     including the folded algae) */
+  std::map<std::string, size_t> census(void) const {
+    Bind bind(const_cast<World*>(this));
+    std::map<std::string, size_t> counts;
+    for (LifeForm* lf : life->all_life)
+      if (lf->is_alive) counts[lf->species_name()] += 1;
+#if MEAN_FIELD_ALGAE
+    if (life->field.size() > 0) counts["Algae"] += life->field.size();
+#endif /* MEAN_FIELD_ALGAE */
+    return counts;
+  }
+
+  unsigned tree_depth(void) const { return life->space.depth(); }
+};
+
+#endif /* !(_World_h) */
@@ -0,0 +1,659 @@
+#if !(_WorldSnapshot_h)
+#define _WorldSnapshot_h 1
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#if !defined(_MSC_VER)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#include "Checkpoint.h"
+#include "Event.h"
+#include "LifeForm.h"
+#include "QuadTree.h"
+
+/*
+ * World snapshots: a columnar, mmap-friendly form of a checkpoint, for
+ * scenarios that start from the same large initial state every run.
+ *
+ * A checkpoint (Checkpoint.h) is a stream of one record per object and
+ * per event; restoring it builds the world one insert at a time.  A
+ * snapshot holds the same state, laid out for loading in bulk:
+ *
+ *   Header        magic "EPLSNAP", version, SimTime representation, the
+ *                 object and event counts, and the offset and size of
+ *                 every section
+ *   preamble      (CheckpointWriter) clock, sequence counter, random
+ *                 state, draw_uniform seed and next serial, the species
+ *                 names, the event tag names and, with MEAN_FIELD_ALGAE,
+ *                 the mean field's cells as they are (MeanFieldAlgae::save)
+ *   columns       one array per field, each starting on a 64 byte
+ *                 boundary: the objects' species, serial, x, y, course,
+ *                 speed, energy, update and reproduce times, their
+ *                 save_state bytes (end offsets + bytes), their
+ *                 EnergyAccounts (LAZY_ENERGY only; energies settled
+ *                 first), the pending events' tag, target, argument,
+ *                 time and sequence number, and the objects' pending
+ *                 WakeTimer actions' tag, object and time
+ *
+ * The file is mapped (read into memory on Windows), and the loader reads
+ * the columns in place.  It creates the LifeForms in one pass (their
+ * constructors' events are dropped and deleted, as in Checkpoint::restore),
+ * builds the QuadTree top down (QuadTree::insert_bulk), rebinds the events
+ * and actions through the Checkpoint rebinders (per species first, as
+ * Checkpoint does) and heapifies the queue once (Event::insert_all).  No
+ * region_resize callbacks run and nothing is scheduled twice, so the load
+ * is one linear pass over the file plus the species' constructors.
+ * last_load() says where the time went.
+ *
+ * save() refuses (writing nothing) a world with a pending event or action
+ * that has no rebinder, and load() refuses a file with one, or stops at a
+ * rebinder that does not schedule exactly one event.
+ *
+ * Snapshots are in the writer's byte order and SimTime representation;
+ * load() refuses any other.  Like Checkpoint::restore, load() must be
+ * called on an empty world, and the resumed run is the same as the run
+ * that was saved.
+ *
+ * Recommended Usage:
+ *   World w(seed);
+ *   World::Bind bind(&w);
+ *   if (!WorldSnapshot::load("million.snap")) {
+ *     w.populate(mix);
+ *     WorldSnapshot::save("million.snap");
+ *   }
+ */
+class WorldSnapshot {
+public:
+  static const uint32_t version = 4;  // 2: LAZY_ENERGY accounts
+                                      // 3: WakeTimer actions
+                                      // 4: the mean field (MEAN_FIELD_ALGAE)
+
+  enum Column {
+    COL_SPECIES,                // uint32_t: index into the species names
+    COL_SERIAL,                 // uint64_t
+    COL_X,                      // double (and so on, to COL_REPRODUCE_TIME)
+    COL_Y,
+    COL_COURSE,
+    COL_SPEED,
+    COL_ENERGY,
+    COL_UPDATE_TIME,
+    COL_REPRODUCE_TIME,
+    COL_STATE_END,              // uint64_t: end of each object's bytes in COL_STATE
+    COL_STATE,                  // char: what save_state wrote
+    COL_ACCOUNT,                // EnergyAccount (empty without LAZY_ENERGY)
+    COL_EVENT_TAG,              // uint32_t: index into the tag names
+    COL_EVENT_TARGET,           // int64_t: object index, or -1
+    COL_EVENT_ARG,              // double
+    COL_EVENT_TIME,             // SimTime
+    COL_EVENT_SEQ,              // uint64_t
+    COL_ACTION_TAG,             // uint32_t: index into the tag names
+    COL_ACTION_TARGET,          // int64_t: object index
+    COL_ACTION_TIME,            // SimTime
+    NUM_COLUMNS
+  };
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_bytes;      // sizeof(Header) of the writer
+    uint32_t byte_order;        // 0x01020304 as the writer stores it
+    uint32_t mean_field;        // Checkpoint::field_model() of the writer
+    int64_t ticks_per_unit;     // 0 for double time
+    uint64_t num_objects;
+    uint64_t num_events;
+    uint64_t num_actions;
+    uint64_t preamble_offset;
+    uint64_t preamble_bytes;
+    uint64_t offset[NUM_COLUMNS];
+    uint64_t bytes[NUM_COLUMNS];
+  };
+
+  /* where the last load() spent its time, in seconds */
+  struct LoadTimes {
+    uint64_t bytes = 0;         // the file's size
+    double read = 0.0;          // map the file, check the header and columns
+    double create = 0.0;        // the species' constructors and restore_state
+    double index = 0.0;         // QuadTree::insert_bulk
+    double events = 0.0;        // rebind the events and actions, build the queue
+    double total = 0.0;
+  };
+
+  static bool save(const std::string& path);
+  static bool load(const std::string& path);
+  static const LoadTimes& last_load(void) { return load_times(); }
+
+private:
+  static LoadTimes& load_times(void) {
+    static LoadTimes times;
+    return times;
+  }
+
+  static double since(std::chrono::steady_clock::time_point& mark) {
+    auto now = std::chrono::steady_clock::now();
+    double s = std::chrono::duration<double>(now - mark).count();
+    mark = now;
+    return s;
+  }
+
+  static const uint64_t alignment = 64;
+
+  static const char* magic(void) { return "EPLSNAP"; } // 8 bytes with the NUL
+
+  /*
+   * Class name: MappedFile
+   * Description:
+   *  a whole file, read only: mapped where there is mmap, read into
+   *  memory where there is not
+   */
+  class MappedFile {
+    const char* base;
+    size_t length;
+    std::vector<char> copy;
+
+  public:
+    explicit MappedFile(const std::string& path) : base(nullptr), length(0) {
+#if !defined(_MSC_VER)
+      int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0) return;
+      struct stat st;
+      if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+          madvise(p, size_t(st.st_size), MADV_SEQUENTIAL);
+          madvise(p, size_t(st.st_size), MADV_WILLNEED);
+          base = static_cast<const char*>(p);
+          length = size_t(st.st_size);
+        }
+      }
+      close(fd);
+#else
+      std::ifstream in(path, std::ios::binary | std::ios::ate);
+      if (!in) return;
+      copy.resize(size_t(in.tellg()));
+      in.seekg(0);
+      if (!copy.empty() && in.read(&copy[0], copy.size())) {
+        base = &copy[0];
+        length = copy.size();
+      }
+#endif
+    }
+
+    ~MappedFile(void) {
+#if !defined(_MSC_VER)
+      if (base != nullptr) munmap(const_cast<char*>(base), length);
+#endif
+    }
+
+    bool ok(void) const { return base != nullptr; }
+    const char* data(void) const { return base; }
+    size_t size(void) const { return length; }
+
+  private:
+    MappedFile(const MappedFile&) = delete;
+    void operator=(const MappedFile&) = delete;
+  };
+
+  /* the column 'c' of the file, as 'count' T's (nullptr if the header does
+     not describe exactly that inside the file) */
+  template <typename T>
+  static const T* column(const MappedFile& file, const Header& h, Column c, uint64_t count) {
+    if (h.bytes[c] != count * sizeof(T) || h.offset[c] % alignof(T) != 0 ||
+        h.offset[c] > file.size() || h.bytes[c] > file.size() - h.offset[c]) {
+      std::cerr << "snapshot: column " << c << " is damaged\n";
+      return nullptr;
+    }
+    return reinterpret_cast<const T*>(file.data() + h.offset[c]);
+  }
+
+  template <typename T>
+  static void write_column(std::ostream& out, Header& h, Column c, const std::vector<T>& v) {
+    uint64_t at = uint64_t(out.tellp());
+    uint64_t pad = (alignment - at % alignment) % alignment;
+    static const char zeros[alignment] = {};
+    out.write(zeros, pad);
+    h.offset[c] = at + pad;
+    h.bytes[c] = v.size() * sizeof(T);
+    if (!v.empty()) out.write(reinterpret_cast<const char*>(v.data()), h.bytes[c]);
+  }
+};
+
+inline bool WorldSnapshot::save(const std::string& path) {
+  Header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, magic(), 8);
+  h.version = version;
+  h.header_bytes = sizeof(Header);
+  h.byte_order = 0x01020304;
+  h.ticks_per_unit = SimTime::ticks_per_unit;
+  h.mean_field = Checkpoint::field_model();
+
+  /* the objects, in all_life order, and the species they belong to */
+  std::vector<LifeForm*> alive;
+  std::unordered_map<const void*, int64_t> index;
+  std::vector<std::string> species_names;
+  std::map<SpeciesId, uint32_t> species_index;
+  std::vector<uint32_t> species;
+  std::vector<uint64_t> serial;
+  std::vector<double> x, y, course, speed, energy, update_time, reproduce_time;
+  std::vector<uint64_t> state_end;
+  std::vector<char> state;
+#if LAZY_ENERGY
+  std::vector<EnergyAccount> account;
+#else
+  std::vector<char> account;
+#endif /* LAZY_ENERGY */
+  for (LifeForm* lf : LifeForm::all_life()) {
+    if (!lf->is_alive) continue;
+#if LAZY_ENERGY
+    lf->sync_energy();          // (every tick up to now applied)
+    account.push_back(lf->account);
+#endif /* LAZY_ENERGY */
+    index[lf] = alive.size();
+    alive.push_back(lf);
+    SpeciesId s = lf->species_id();
+    auto p = species_index.find(s);
+    if (p == species_index.end()) {
+      p = species_index.insert(std::make_pair(s, uint32_t(species_names.size()))).first;
+      species_names.push_back(lf->species_name());
+    }
+    species.push_back(p->second);
+    serial.push_back(lf->serial);
+    Point pos = lf->hot_position();
+    x.push_back(pos.xpos);
+    y.push_back(pos.ypos);
+    course.push_back(lf->hot_course());
+    speed.push_back(lf->hot_speed());
+    energy.push_back(lf->hot_energy());
+    update_time.push_back(lf->hot_update_time());
+    reproduce_time.push_back(lf->reproduce_time);
+
+    std::ostringstream extra;
+    CheckpointWriter species_writer(extra);
+    lf->save_state(species_writer);
+    std::string bytes = extra.str();
+    state.insert(state.end(), bytes.begin(), bytes.end());
+    state_end.push_back(state.size());
+  }
+
+  /* the pending events of live objects (and of none), in the order they
+     will occur */
+  std::vector<Event*> pending;
+  Event::for_each_pending([&pending, &index](Event* e) {
+    if (e->active && (e->target == nullptr || index.count(e->target))) pending.push_back(e);
+  });
+  std::sort(pending.begin(), pending.end(), [](const Event* a, const Event* b) {
+    return a->t < b->t || (a->t == b->t && a->seq < b->seq);
+  });
+
+  /* every event and action that is saved must be restorable */
+  bool restorable = true;
+  for (Event* e : pending) {
+    if (e->tag == EVENT_WAKEUP) continue;       // (rebuilt with the actions)
+    const LifeForm* target = e->target;
+    std::string name = EventProfiler::tag_name(e->tag);
+    if (Checkpoint::rebinder_for(name, target) == nullptr) {
+      std::cerr << "snapshot: no rebinder for a pending \"" << name << "\" event"
+                << (target ? " of a " + target->species_name() : std::string()) << "\n";
+      restorable = false;
+    }
+  }
+  for (LifeForm* lf : alive) {
+    for (const WakeTimer::Pending& a : lf->timers.pending) {
+      std::string name = EventProfiler::tag_name(a.tag);
+      if (Checkpoint::action_rebinder_for(name, lf) == nullptr) {
+        std::cerr << "snapshot: no rebinder for a pending \"" << name << "\" action of a "
+                  << lf->species_name() << "\n";
+        restorable = false;
+      }
+    }
+  }
+  if (!restorable) return false;
+
+  std::vector<std::string> tag_names;
+  std::map<EventTag, uint32_t> tag_index;
+  auto name_tag = [&tag_names, &tag_index](EventTag t) {
+    auto p = tag_index.find(t);
+    if (p == tag_index.end()) {
+      p = tag_index.insert(std::make_pair(t, uint32_t(tag_names.size()))).first;
+      tag_names.push_back(EventProfiler::tag_name(t));
+    }
+    return p->second;
+  };
+  std::vector<uint32_t> tag;
+  std::vector<int64_t> target;
+  std::vector<double> arg;
+  std::vector<SimTime> when;
+  std::vector<uint64_t> seq;
+  for (Event* e : pending) {
+    tag.push_back(name_tag(e->tag));
+    target.push_back(e->target ? index[e->target] : -1);
+    arg.push_back(e->arg);
+    when.push_back(e->t);
+    seq.push_back(e->seq);
+  }
+
+  /* each object's actions, in the order they will run */
+  std::vector<uint32_t> action_tag;
+  std::vector<int64_t> action_target;
+  std::vector<SimTime> action_time;
+  for (size_t k = 0; k < alive.size(); k += 1) {
+    for (const WakeTimer::Pending& a : alive[k]->timers.pending) {
+      action_tag.push_back(name_tag(a.tag));
+      action_target.push_back(k);
+      action_time.push_back(a.when);
+    }
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    std::cerr << "snapshot: cannot write " << path << "\n";
+    return false;
+  }
+  out.write(reinterpret_cast<const char*>(&h), sizeof(h));   // (again at the end)
+
+  std::ostringstream preamble;
+  CheckpointWriter w(preamble);
+  w.put<SimTime>(Event::now());
+  w.put<uint64_t>(Event::sequence_counter());
+  Checkpoint::save_random(w);
+  w.put<uint64_t>(LifeForm::world_seed());
+  w.put<uint64_t>(LifeForm::habitat().next_serial);
+  w.put<uint32_t>(species_names.size());
+  for (const std::string& name : species_names) w.put_string(name);
+  w.put<uint32_t>(tag_names.size());
+  for (const std::string& name : tag_names) w.put_string(name);
+#if MEAN_FIELD_ALGAE
+  LifeForm::habitat().field.save(w);      // (the folded algae, as they are)
+#endif /* MEAN_FIELD_ALGAE */
+  std::string pre = preamble.str();
+  h.preamble_offset = uint64_t(out.tellp());
+  h.preamble_bytes = pre.size();
+  out.write(pre.data(), pre.size());
+
+  h.num_objects = alive.size();
+  h.num_events = pending.size();
+  h.num_actions = action_tag.size();
+  write_column(out, h, COL_SPECIES, species);
+  write_column(out, h, COL_SERIAL, serial);
+  write_column(out, h, COL_X, x);
+  write_column(out, h, COL_Y, y);
+  write_column(out, h, COL_COURSE, course);
+  write_column(out, h, COL_SPEED, speed);
+  write_column(out, h, COL_ENERGY, energy);
+  write_column(out, h, COL_UPDATE_TIME, update_time);
+  write_column(out, h, COL_REPRODUCE_TIME, reproduce_time);
+  write_column(out, h, COL_STATE_END, state_end);
+  write_column(out, h, COL_STATE, state);
+  write_column(out, h, COL_ACCOUNT, account);
+  write_column(out, h, COL_EVENT_TAG, tag);
+  write_column(out, h, COL_EVENT_TARGET, target);
+  write_column(out, h, COL_EVENT_ARG, arg);
+  write_column(out, h, COL_EVENT_TIME, when);
+  write_column(out, h, COL_EVENT_SEQ, seq);
+  write_column(out, h, COL_ACTION_TAG, action_tag);
+  write_column(out, h, COL_ACTION_TARGET, action_target);
+  write_column(out, h, COL_ACTION_TIME, action_time);
+
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  return bool(out);
+}
+
+inline bool WorldSnapshot::load(const std::string& path) {
+  LoadTimes& times = load_times();
+  times = LoadTimes();
+  auto started = std::chrono::steady_clock::now();
+  auto mark = started;
+
+  MappedFile file(path);
+  if (!file.ok()) return false;               // (no snapshot yet is not an error)
+  times.bytes = file.size();
+  Header h;
+  if (file.size() < sizeof(h)) {
+    std::cerr << "snapshot: " << path << " is too short\n";
+    return false;
+  }
+  memcpy(&h, file.data(), sizeof(h));
+  if (memcmp(h.magic, magic(), 8) != 0 || h.header_bytes != sizeof(Header) ||
+      h.byte_order != 0x01020304) {
+    std::cerr << "snapshot: " << path << " is not a snapshot written on this kind of machine\n";
+    return false;
+  }
+  if (h.version != version) {
+    std::cerr << "snapshot: unsupported version\n";
+    return false;
+  }
+  if (h.ticks_per_unit != SimTime::ticks_per_unit) {
+    std::cerr << "snapshot: written with a different SimTime representation\n";
+    return false;
+  }
+  if (h.mean_field != Checkpoint::field_model()) {
+    std::cerr << "snapshot: written with a different MEAN_FIELD_ALGAE setting\n";
+    return false;
+  }
+  if (h.preamble_offset > file.size() || h.preamble_bytes > file.size() - h.preamble_offset) {
+    std::cerr << "snapshot: the preamble is damaged\n";
+    return false;
+  }
+  assert(LifeForm::all_life().empty() && Event::num_events() == 0);
+
+  uint64_t n = h.num_objects, m = h.num_events, na = h.num_actions;
+  const uint32_t* species = column<uint32_t>(file, h, COL_SPECIES, n);
+  const uint64_t* serial = column<uint64_t>(file, h, COL_SERIAL, n);
+  const double* x = column<double>(file, h, COL_X, n);
+  const double* y = column<double>(file, h, COL_Y, n);
+  const double* course = column<double>(file, h, COL_COURSE, n);
+  const double* speed = column<double>(file, h, COL_SPEED, n);
+  const double* energy = column<double>(file, h, COL_ENERGY, n);
+  const double* update_time = column<double>(file, h, COL_UPDATE_TIME, n);
+  const double* reproduce_time = column<double>(file, h, COL_REPRODUCE_TIME, n);
+  const uint64_t* state_end = column<uint64_t>(file, h, COL_STATE_END, n);
+  uint64_t state_bytes = n > 0 && state_end ? state_end[n - 1] : 0;
+  const char* state = column<char>(file, h, COL_STATE, state_bytes);
+#if LAZY_ENERGY
+  if (n > 0 && h.bytes[COL_ACCOUNT] == 0) {
+    std::cerr << "snapshot: written without LAZY_ENERGY\n";
+    return false;
+  }
+  const EnergyAccount* account = column<EnergyAccount>(file, h, COL_ACCOUNT, n);
+#else
+  if (h.bytes[COL_ACCOUNT] != 0) {
+    std::cerr << "snapshot: written with LAZY_ENERGY\n";
+    return false;
+  }
+  const char* account = state;  // (unused)
+#endif /* LAZY_ENERGY */
+  const uint32_t* tag = column<uint32_t>(file, h, COL_EVENT_TAG, m);
+  const int64_t* target = column<int64_t>(file, h, COL_EVENT_TARGET, m);
+  const double* arg = column<double>(file, h, COL_EVENT_ARG, m);
+  const SimTime* when = column<SimTime>(file, h, COL_EVENT_TIME, m);
+  const uint64_t* seq = column<uint64_t>(file, h, COL_EVENT_SEQ, m);
+  const uint32_t* action_tag = column<uint32_t>(file, h, COL_ACTION_TAG, na);
+  const int64_t* action_target = column<int64_t>(file, h, COL_ACTION_TARGET, na);
+  const SimTime* action_time = column<SimTime>(file, h, COL_ACTION_TIME, na);
+  if ((n > 0 && !(species && serial && x && y && course && speed && energy &&
+                  update_time && reproduce_time && state_end && state && account)) ||
+      (m > 0 && !(tag && target && arg && when && seq)) ||
+      (na > 0 && !(action_tag && action_target && action_time)))
+    return false;
+
+  std::istringstream preamble(std::string(file.data() + h.preamble_offset, h.preamble_bytes));
+  CheckpointReader r(preamble);
+  SimTime now = r.get<SimTime>();
+  uint64_t next_seq = r.get<uint64_t>();
+  Checkpoint::restore_random(r);
+  uint64_t seed = r.get<uint64_t>();
+  uint64_t next_serial = r.get<uint64_t>();
+
+  LFCreatorTable& creators = LifeForm::istream_creators();
+  std::vector<std::string> species_names(r.get<uint32_t>());
+  std::vector<IstreamCreator*> create(species_names.size(), nullptr);
+  for (size_t k = 0; k < species_names.size(); k += 1) {
+    species_names[k] = r.get_string();
+    auto p = creators.find(species_names[k]);
+    if (p != creators.end()) create[k] = &p->second;
+    else std::cerr << "snapshot: species " << species_names[k] << " is not registered\n";
+  }
+  std::vector<std::string> tag_names(r.get<uint32_t>());
+  for (std::string& name : tag_names) name = r.get_string();
+#if MEAN_FIELD_ALGAE
+  MeanFieldAlgae field;
+  if (!field.restore(r)) {
+    std::cerr << "snapshot: the mean field is damaged\n";
+    return false;
+  }
+#endif /* MEAN_FIELD_ALGAE */
+  if (!r.ok()) {
+    std::cerr << "snapshot: the preamble is damaged\n";
+    return false;
+  }
+
+  /* check everything that could stop the load half way before creating
+     anything, and find each event's and action's rebinder (per species
+     first, see Checkpoint::find_rebinder) */
+  for (uint64_t k = 0; k < n; k += 1) {
+    if (species[k] >= create.size() || create[species[k]] == nullptr ||
+        (k > 0 && state_end[k] < state_end[k - 1]) ||
+        LifeForm::space().is_out_of_bounds(Point(x[k], y[k]))) {
+      std::cerr << "snapshot: cannot create object " << k << "\n";
+      return false;
+    }
+  }
+  const std::string wakeup_name = EventProfiler::tag_name(EVENT_WAKEUP);
+  auto species_of = [&](int64_t object) {
+    return object >= 0 ? species_names[species[object]] : std::string();
+  };
+  std::vector<const Checkpoint::Rebinder*> rebind(m, nullptr);
+  for (uint64_t k = 0; k < m; k += 1) {
+    bool ok = tag[k] < tag_names.size() && target[k] >= -1 && target[k] < int64_t(n);
+    if (ok && target[k] >= 0 && tag_names[tag[k]] == wakeup_name) continue;
+    if (ok) rebind[k] = Checkpoint::find_rebinder(Checkpoint::rebinders(), tag_names[tag[k]],
+                                                  species_of(target[k]));
+    if (rebind[k] == nullptr) {
+      std::cerr << "snapshot: cannot restore event " << k << "\n";
+      return false;
+    }
+  }
+  std::vector<const Checkpoint::ActionRebinder*> action_rebind(na, nullptr);
+  for (uint64_t k = 0; k < na; k += 1) {
+    if (action_tag[k] < tag_names.size() && action_target[k] >= 0 && action_target[k] < int64_t(n))
+      action_rebind[k] = Checkpoint::find_rebinder(Checkpoint::action_rebinders(),
+                                                   tag_names[action_tag[k]],
+                                                   species_of(action_target[k]));
+    if (action_rebind[k] == nullptr) {
+      std::cerr << "snapshot: cannot restore action " << k << "\n";
+      return false;
+    }
+  }
+  times.read = since(mark);
+
+  Event::state().now = now;
+  LifeForm::habitat().seed = seed;
+  std::ostringstream random_state;            // (the constructors draw from it)
+  CheckpointWriter random_writer(random_state);
+  Checkpoint::save_random(random_writer);
+
+  /* the constructors' own events are replaced by the snapshot's: staged
+     here, forgotten by their objects, and deleted once the load is done */
+  std::vector<Event*> discarded;
+  Event::staged_events() = &discarded;
+
+  std::vector<LifeForm*> objects;
+  objects.reserve(n);
+  LifeForm::all_life().reserve(n);
+  typedef QuadTree<SmartPointer<LifeForm>> Space;
+  std::vector<Space::Entry> entries;
+  entries.reserve(n);
+  for (uint64_t k = 0; k < n; k += 1) {
+    SmartPointer<LifeForm> obj = (*create[species[k]])();
+    LifeForm* lf = &*obj;
+    Point pos(x[k], y[k]);
+    lf->serial = serial[k];
+    lf->hot_energy() = energy[k];
+    lf->set_hot_position(pos);
+    lf->hot_update_time() = update_time[k];
+    lf->reproduce_time = reproduce_time[k];
+    lf->hot_course() = course[k];
+    lf->hot_speed() = speed[k];
+#if LAZY_ENERGY
+    lf->account = account[k];
+#endif /* LAZY_ENERGY */
+    lf->start_point = pos;
+    lf->is_alive = true;
+    Checkpoint::forget_constructor_events(lf);
+
+    uint64_t begin = k > 0 ? state_end[k - 1] : 0;
+    if (state_end[k] > begin) {
+      std::istringstream extra(std::string(state + begin, state_end[k] - begin));
+      CheckpointReader species_reader(extra);
+      lf->restore_state(species_reader);
+    }
+    entries.push_back(Space::Entry{ obj, pos, [lf]() { lf->region_resize(); } });
+    objects.push_back(lf);
+  }
+  std::istringstream random_again(random_state.str());
+  CheckpointReader random_reader(random_again);
+  Checkpoint::restore_random(random_reader);
+  times.create = since(mark);
+
+  LifeForm::space().insert_bulk(entries);
+#if MEAN_FIELD_ALGAE
+  LifeForm::habitat().field = std::move(field);   // (before its sweep is rebound)
+#endif /* MEAN_FIELD_ALGAE */
+  times.index = since(mark);
+
+  std::vector<Event*> restored;
+  std::vector<Checkpoint::SavedWakeup> wakeups;
+  restored.reserve(m);
+  Event::staged_events() = &restored;
+  for (uint64_t k = 0; k < m; k += 1) {
+    LifeForm* owner = target[k] >= 0 ? objects[target[k]] : nullptr;
+    if (rebind[k] == nullptr) {                 // (a wakeup: rebuilt with the actions)
+      wakeups.push_back({ owner, when[k], seq[k] });
+      continue;
+    }
+    size_t before = restored.size();
+    Event* e = (*rebind[k])(owner, arg[k], when[k] - now);
+    if (restored.size() != before + 1 || restored.back() != e) {
+      std::cerr << "snapshot: the rebinder of \"" << tag_names[tag[k]]
+                << "\" must schedule exactly one event and return it\n";
+      Event::staged_events() = nullptr;
+      return false;
+    }
+    e->t = when[k];             // exactly, not now + delta
+    e->seq = seq[k];
+  }
+  for (uint64_t k = 0; k < na; k += 1) {
+    LifeForm* owner = objects[action_target[k]];
+    owner->timers.restore_deadline((*action_rebind[k])(owner, action_time[k] - now),
+                                   action_time[k]);
+  }
+  Checkpoint::restore_wakeups(wakeups);
+  Event::staged_events() = nullptr;
+
+  Event::sequence_counter() = next_seq;
+  for (Event* e : restored)
+    if (e->seq == 0) e->seq = Event::sequence_counter()++;  // (a wakeup not saved)
+  Event::insert_all(restored);
+  for (Event* e : discarded) delete e;   // (nothing refers to them now)
+  LifeForm::habitat().next_serial = next_serial;
+  times.events = since(mark);
+  times.total = since(started);
+  return true;
+}
+
+#endif /* !(_WorldSnapshot_h) */
@@ -20,6 +20,7 @@ public:
   std::string species_name(void) const;
   std::string player_name(void) const;
   Action encounter(const ObjInfo&);
+  void forget_events(void) { hunt_event = nullptr; }
   friend class Initializer<wf2796>;
 };
 